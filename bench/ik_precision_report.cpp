@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <inverse_kinematics.hpp>
+
+// samples reachable poses (FK of random joint states) and reports, per
+// scalar type, how fast solve_task is and how far FK(IK(p)) lands from p
+
+namespace {
+
+using bench_clock = std::chrono::steady_clock;
+
+std::vector<pusn::internal::puma_state> random_states(std::size_t count,
+                                                      std::uint32_t seed) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<float> extension(1.f, 20.f);
+  std::uniform_real_distribution<float> angle(0.f, 360.f);
+
+  std::vector<pusn::internal::puma_state> ret(count);
+  for (auto &s : ret) {
+    s.q2 = extension(gen);
+    s.alpha_1 = angle(gen);
+    s.alpha_2 = angle(gen);
+    s.alpha_3 = angle(gen);
+    s.alpha_4 = angle(gen);
+    s.alpha_5 = angle(gen);
+  }
+  return ret;
+}
+
+template <typename T>
+pusn::internal::basic_puma_state<T>
+convert(const pusn::internal::puma_state &s) {
+  return {T(s.base_x),  T(s.base_y),  T(s.l1),      T(s.q2),
+          T(s.l3),      T(s.l4),      T(s.alpha_1), T(s.alpha_2),
+          T(s.alpha_3), T(s.alpha_4), T(s.alpha_5)};
+}
+
+template <typename T> struct round_trip {
+  double max_error{0.0};
+  double sum_error{0.0};
+  std::size_t solutions{0};
+
+  void add(double error) {
+    max_error = std::max(max_error, error);
+    sum_error += error;
+    ++solutions;
+  }
+  double mean() const { return solutions ? sum_error / solutions : 0.0; }
+};
+
+template <typename T>
+void report(const char *name,
+            const std::vector<pusn::internal::puma_state> &samples) {
+  std::vector<pusn::internal::basic_puma_state<T>> states;
+  std::vector<pusn::basic_puma_pos<T>> poses;
+  for (const auto &s : samples) {
+    states.push_back(convert<T>(s));
+    const auto fk = pusn::forward_kinematics(states.back());
+    poses.push_back({fk.pos, glm::quat_cast(fk.frame)});
+  }
+
+  const auto &robot = states.front();
+  std::vector<pusn::basic_ik_solutions<T>> solutions(poses.size());
+  const auto start = bench_clock::now();
+  for (std::size_t i = 0; i < poses.size(); ++i) {
+    solutions[i] = pusn::solve_task(robot, poses[i]);
+  }
+  const std::chrono::duration<double> elapsed = bench_clock::now() - start;
+
+  round_trip<T> analytic;
+  round_trip<T> refined;
+  std::size_t unreachable = 0;
+  for (std::size_t i = 0; i < poses.size(); ++i) {
+    if (solutions[i].empty()) {
+      ++unreachable;
+      continue;
+    }
+    for (std::size_t b = 0; b < pusn::basic_ik_solutions<T>::capacity; ++b) {
+      if (!solutions[i].is_valid(b)) {
+        continue;
+      }
+      auto state = solutions[i].states[b];
+      analytic.add(glm::length(pusn::get_actuator_pos(state) - poses[i].pos));
+      refined.add(pusn::refine_task(state, poses[i]).position);
+    }
+  }
+
+  std::printf("%-7s %12.0f poses/s  %8.1f ns/pose\n", name,
+              poses.size() / elapsed.count(),
+              elapsed.count() * 1e9 / poses.size());
+  std::printf("        FK(IK(p)) - p    max %-12g mean %-12g (%zu solutions)\n",
+              analytic.max_error, analytic.mean(), analytic.solutions);
+  std::printf("        after refine     max %-12g mean %-12g\n",
+              refined.max_error, refined.mean());
+  std::printf("        poses without a valid branch %zu\n", unreachable);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const std::size_t count =
+      argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000;
+  const auto samples = random_states(count, 2024u);
+
+  std::printf("%zu reachable poses\n", count);
+  report<float>("float", samples);
+  report<double>("double", samples);
+  return 0;
+}
@@ -0,0 +1,1117 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <gcode.hpp>
+#include <ik_cache.hpp>
+#include <inverse_kinematics.hpp>
+#include <mock_data.hpp>
+#include <motion_program.hpp>
+#include <simulation.hpp>
+#include <trajectory.hpp>
+
+// every heap allocation of the process goes through here, so sections can
+// check they stay off the heap. Storage still comes from malloc, which is
+// what the default operator delete releases
+static std::atomic<std::size_t> allocation_count{0};
+
+void *operator new(std::size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  if (void *ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc{};
+}
+
+namespace {
+
+using bench_clock = std::chrono::steady_clock;
+
+template <typename Func> double time_ms(Func &&f) {
+  const auto start = bench_clock::now();
+  f();
+  const std::chrono::duration<double, std::milli> elapsed =
+      bench_clock::now() - start;
+  return elapsed.count();
+}
+
+std::vector<pusn::puma_pos> random_poses(std::size_t count,
+                                         std::uint32_t seed) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<float> coord(-20.f, 20.f);
+  std::uniform_real_distribution<float> height(0.f, 30.f);
+  std::uniform_real_distribution<float> angle(0.f, 2 * glm::pi<float>());
+
+  std::vector<pusn::puma_pos> ret(count);
+  for (auto &p : ret) {
+    p.pos = {coord(gen), coord(gen), height(gen)};
+    p.rot = glm::quat(glm::vec3{angle(gen), angle(gen), angle(gen)});
+  }
+  return ret;
+}
+
+std::vector<pusn::internal::puma_state> random_states(std::size_t count,
+                                                      std::uint32_t seed) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<float> extension(0.f, 20.f);
+  std::uniform_real_distribution<float> angle(0.f, 360.f);
+
+  std::vector<pusn::internal::puma_state> ret(count);
+  for (auto &s : ret) {
+    s.q2 = extension(gen);
+    s.alpha_1 = angle(gen);
+    s.alpha_2 = angle(gen);
+    s.alpha_3 = angle(gen);
+    s.alpha_4 = angle(gen);
+    s.alpha_5 = angle(gen);
+  }
+  return ret;
+}
+
+// the mat4 chain get_actuator_pos used to build, kept as the reference the
+// generated chain is measured against
+glm::vec3 matrix_chain_actuator_pos(const pusn::internal::puma_state &state) {
+  glm::vec4 res{state.l4, 0.f, 0.f, 1.f};
+  glm::mat4 skinning_matrix = glm::mat4(1.f);
+  auto mmat =
+      math::get_model_matrix({0.f, 0.f, 0.f}, {5.f, 1.f, 5.f},
+                             math::deg_to_rad(glm::vec3{0.f, 0.f, 0.f}));
+
+  mmat = math::get_model_matrix({0.f, 0.f, 0.f}, {1.f, 1.f, 1.f},
+                                math::deg_to_rad(glm::vec3{0.f, 0.f, 0.f}));
+
+  mmat = math::get_model_matrix(
+      {0.f, state.l1, 0.f}, {1.f, 1.f, 1.f},
+      math::deg_to_rad(glm::vec3{0.f, state.alpha_1, 0.f}));
+  skinning_matrix = mmat * skinning_matrix;
+
+  // arm2
+  mmat = math::get_model_matrix(
+      {0.f, 0.f, 0.f}, {1.f, 1.f, 1.f},
+      math::deg_to_rad(glm::vec3{0.f, 0.f, -state.alpha_2}));
+  skinning_matrix = skinning_matrix * mmat;
+
+  // joint23
+  mmat = math::get_model_matrix({state.q2, 0.f, 0.f}, {1.f, 1.f, 1.f},
+                                math::deg_to_rad(glm::vec3{0.f, 0.f, 0.f}));
+  skinning_matrix = skinning_matrix * mmat;
+
+  // arm3
+  mmat = math::get_model_matrix(
+      {0.f, 0.f, 0.f}, {1.f, 1.f, 1.f},
+      math::deg_to_rad(glm::vec3{0.f, 0.f, -state.alpha_3}));
+  skinning_matrix = skinning_matrix * mmat;
+
+  // arm4
+  mmat = math::get_model_matrix(
+      {0.f, -state.l3, 0.f}, {1.f, 1.f, 1.f},
+      math::deg_to_rad(glm::vec3{0.f, state.alpha_4, 0.f}));
+  skinning_matrix = skinning_matrix * mmat;
+
+  auto pret = skinning_matrix * res;
+  pret.z *= -1;
+  std::swap(pret.y, pret.z);
+  return pret;
+}
+
+void bench_fk(std::size_t count) {
+  const auto states = random_states(count, 4242u);
+
+  glm::vec3 chain_sum{0.f};
+  const auto chain_ms = time_ms([&]() {
+    for (const auto &s : states) {
+      chain_sum += matrix_chain_actuator_pos(s);
+    }
+  });
+
+  glm::vec3 closed_sum{0.f};
+  const auto closed_ms = time_ms([&]() {
+    for (const auto &s : states) {
+      closed_sum += pusn::forward_kinematics(s).pos;
+    }
+  });
+
+  std::vector<pusn::effector_pose> poses(count);
+  const auto batch_ms =
+      time_ms([&]() { pusn::forward_kinematics_batch(states, poses); });
+
+  float max_error = 0.f;
+  for (std::size_t i = 0; i < count; ++i) {
+    max_error = std::max(
+        max_error,
+        glm::length(matrix_chain_actuator_pos(states[i]) - poses[i].pos));
+  }
+
+  std::printf("[fk] %zu states\n", count);
+  std::printf("  mat4 chain       %10.3f ms  %8.1f ns/call\n", chain_ms,
+              chain_ms * 1e6 / count);
+  std::printf("  generated FK     %10.3f ms  %8.1f ns/call  (x%.2f)\n",
+              closed_ms, closed_ms * 1e6 / count, chain_ms / closed_ms);
+  std::printf("  generated FK batch%9.3f ms  %8.1f ns/call  (x%.2f)\n",
+              batch_ms, batch_ms * 1e6 / count, chain_ms / batch_ms);
+  std::printf("  max deviation    %g (checksum %g)\n", max_error,
+              glm::length(chain_sum - closed_sum));
+}
+
+// solve_task pose by pose against solve_task_batch on all cores and on one
+// (SIMD lanes alone). Both have to keep the same branches with the same
+// joints, and the batch has to be faster even on a single core
+bool bench_ik(std::size_t count) {
+  pusn::internal::model model;
+  const auto &robot = model.left_puma;
+  const auto poses = random_poses(count, 1337u);
+
+  std::vector<pusn::ik_solutions> scalar(count);
+  const auto scalar_ms = time_ms([&]() {
+    for (std::size_t i = 0; i < count; ++i) {
+      scalar[i] = pusn::solve_task(robot, poses[i]);
+    }
+  });
+
+  pusn::ik_batch_solutions batch;
+  const auto batch_ms =
+      time_ms([&]() { pusn::solve_task_batch(robot, poses, batch); });
+
+  double single_ms = batch_ms;
+#ifdef _OPENMP
+  const auto threads = omp_get_max_threads();
+  omp_set_num_threads(1);
+  single_ms = time_ms([&]() { pusn::solve_task_batch(robot, poses, batch); });
+  omp_set_num_threads(threads);
+#endif
+
+  std::size_t scalar_valid = 0;
+  std::size_t batch_valid = 0;
+  std::size_t mismatches = 0;
+  std::size_t far = 0;
+  float max_dist = 0.f;
+  for (std::size_t i = 0; i < count; ++i) {
+    for (std::size_t b = 0; b < pusn::ik_solutions::capacity; ++b) {
+      const bool s = scalar[i].is_valid(b);
+      const bool v = batch.valid[batch.index(b, i)] != 0;
+      scalar_valid += s;
+      batch_valid += v;
+      mismatches += s != v;
+      if (s && v) {
+        const auto dist = pusn::internal::state_dist(scalar[i].states[b],
+                                                     batch.get(robot, b, i));
+        far += dist > 0.1f;
+        max_dist = std::max(max_dist, dist);
+      }
+    }
+  }
+
+  std::printf("[ik] %zu poses\n", count);
+  std::printf("  solve_task       %10.3f ms  %8.1f ns/pose\n", scalar_ms,
+              scalar_ms * 1e6 / count);
+  std::printf("  solve_task_batch %10.3f ms  %8.1f ns/pose  (x%.2f)\n",
+              batch_ms, batch_ms * 1e6 / count, scalar_ms / batch_ms);
+  std::printf("  batch, 1 thread  %10.3f ms  %8.1f ns/pose  (x%.2f)\n",
+              single_ms, single_ms * 1e6 / count, scalar_ms / single_ms);
+  std::printf("  valid branches   scalar %zu, batch %zu, %zu differ\n",
+              scalar_valid, batch_valid, mismatches);
+  std::printf("  joint diff       max %g, %zu over 0.1\n", max_dist, far);
+  // float lanes differ from the scalar path in the last digits, a branch
+  // right at the reach tolerance may land on either side and one with the
+  // wrist over the base axis (alpha_1 ill conditioned) may move further
+  return single_ms < scalar_ms && batch_ms < scalar_ms &&
+         (mismatches + far) * 10000 <= scalar_valid && max_dist < 1.f;
+}
+
+// follows a move frame by frame once with solve-all-then-pick-nearest and
+// once with branch tracking, both must end up on the same path
+void bench_tracking(std::size_t frames) {
+  pusn::internal::model model;
+  const pusn::puma_pos start{{10.f, 5.f, 10.f}, glm::quat{1.f, 0.f, 0.f, 0.f}};
+  const pusn::puma_pos end{{-5.f, 10.f, 20.f},
+                           glm::quat(glm::vec3{0.5f, 1.f, 0.f})};
+
+  std::vector<pusn::puma_pos> path(frames);
+  for (std::size_t i = 0; i < frames; ++i) {
+    const auto t = static_cast<float>(i) / static_cast<float>(frames);
+    path[i] = {glm::mix(start.pos, end.pos, t),
+               glm::slerp(start.rot, end.rot, t)};
+  }
+  const auto initial = pusn::solve_task(model.left_puma, start).states[0];
+
+  std::vector<pusn::internal::puma_state> nearest(frames);
+  auto current = initial;
+  const auto nearest_ms = time_ms([&]() {
+    for (std::size_t i = 0; i < frames; ++i) {
+      const auto solutions = pusn::solve_task(model.left_puma, path[i]);
+      const auto closest = solutions.closest(current);
+      if (closest != pusn::ik_solutions::capacity) {
+        current = solutions.states[closest];
+      }
+      nearest[i] = current;
+    }
+  });
+
+  std::vector<pusn::internal::puma_state> tracked(frames);
+  pusn::internal::ik_tracking tracking;
+  current = initial;
+  const auto tracked_ms = time_ms([&]() {
+    for (std::size_t i = 0; i < frames; ++i) {
+      pusn::solve_task_tracked(model.left_puma, path[i], tracking, current);
+      tracked[i] = current;
+    }
+  });
+
+  float max_deviation = 0.f;
+  for (std::size_t i = 0; i < frames; ++i) {
+    max_deviation = std::max(
+        max_deviation, pusn::internal::state_dist(nearest[i], tracked[i]));
+  }
+
+  std::printf("[tracking] %zu frames\n", frames);
+  std::printf("  solve all+nearest%10.3f ms  %8.1f ns/frame\n", nearest_ms,
+              nearest_ms * 1e6 / frames);
+  std::printf("  tracked branch   %10.3f ms  %8.1f ns/frame  (x%.2f)\n",
+              tracked_ms, tracked_ms * 1e6 / frames, nearest_ms / tracked_ms);
+  std::printf("  tracked %zu, full solves %zu, max deviation %g\n",
+              tracking.tracked_steps, tracking.full_solves, max_deviation);
+}
+
+// residuals of the analytic solutions before and after refine_task
+void bench_refine(std::size_t count) {
+  pusn::internal::model model;
+  const auto poses = random_poses(count, 7u);
+
+  std::vector<pusn::puma_pos> targets;
+  std::vector<pusn::internal::puma_state> states;
+  for (const auto &p : poses) {
+    const auto solutions = pusn::solve_task(model.left_puma, p);
+    const auto branch = solutions.closest(model.left_puma);
+    if (branch != pusn::ik_solutions::capacity) {
+      targets.push_back(p);
+      states.push_back(solutions.states[branch]);
+    }
+  }
+
+  float analytic_max = 0.f;
+  for (std::size_t i = 0; i < states.size(); ++i) {
+    analytic_max = std::max(
+        analytic_max,
+        glm::length(targets[i].pos - pusn::get_actuator_pos(states[i])));
+  }
+
+  std::vector<pusn::ik_residual> residuals(states.size());
+  const auto ms = time_ms([&]() {
+    for (std::size_t i = 0; i < states.size(); ++i) {
+      residuals[i] = pusn::refine_task(states[i], targets[i]);
+    }
+  });
+
+  float position_max = 0.f;
+  float orientation_max = 0.f;
+  std::size_t iterations = 0;
+  for (const auto &r : residuals) {
+    position_max = std::max(position_max, r.position);
+    orientation_max = std::max(orientation_max, r.orientation);
+    iterations += r.iterations;
+  }
+
+  const auto n = std::max<std::size_t>(states.size(), 1);
+  std::printf("[refine] %zu solutions\n", states.size());
+  std::printf("  refine_task      %10.3f ms  %8.1f ns/solve  %.2f it/solve\n",
+              ms, ms * 1e6 / n, static_cast<double>(iterations) / n);
+  std::printf("  max position residual %g -> %g, orientation %g rad\n",
+              analytic_max, position_max, orientation_max);
+}
+
+// a tool path that keeps revisiting a small set of waypoints, like the
+// plunge/retract points and repeated passes of a milling program
+void bench_cache(std::size_t count) {
+  pusn::internal::model model;
+  const auto waypoints = random_poses(256, 99u);
+
+  std::vector<pusn::puma_pos> path(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    path[i] = waypoints[(i * 7 + i / waypoints.size()) % waypoints.size()];
+  }
+
+  std::size_t direct_valid = 0;
+  const auto direct_ms = time_ms([&]() {
+    for (const auto &p : path) {
+      direct_valid += pusn::solve_task(model.left_puma, p).size();
+    }
+  });
+
+  pusn::ik_cache cache(1024);
+  std::size_t cached_valid = 0;
+  const auto cached_ms = time_ms([&]() {
+    for (const auto &p : path) {
+      cached_valid += cache.solve(model.left_puma, p).size();
+    }
+  });
+
+  const auto &stats = cache.stats();
+  std::printf("[ik cache] %zu poses, %zu distinct, capacity %zu\n", count,
+              waypoints.size(), cache.capacity());
+  std::printf("  solve_task       %10.3f ms  %8.1f ns/pose\n", direct_ms,
+              direct_ms * 1e6 / count);
+  std::printf("  ik_cache::solve  %10.3f ms  %8.1f ns/pose  (x%.2f)\n",
+              cached_ms, cached_ms * 1e6 / count, direct_ms / cached_ms);
+  std::printf("  hit rate %.4f (%zu hits, %zu misses, %zu evictions)\n",
+              stats.hit_rate(), stats.hits, stats.misses, stats.evictions);
+  std::printf("  valid branches   direct %zu, cached %zu\n", direct_valid,
+              cached_valid);
+}
+
+// runs the per-frame animation step over a whole move and counts heap
+// allocations it makes, returns false if there were any
+bool bench_animation_allocations(std::size_t frames) {
+  pusn::internal::model model;
+  auto &settings = model.current_settings.emplace();
+  settings.position_start = {10.f, 5.f, 10.f};
+  settings.position_end = {-5.f, 10.f, 20.f};
+  settings.quat_rotation_end = glm::quat(glm::vec3{0.5f, 1.f, 0.f});
+  settings.start_state = pusn::solve_task(model.left_puma,
+                                          {settings.position_start,
+                                           settings.quat_rotation_start})
+                             .states[0];
+  settings.end_state = settings.start_state;
+  settings.start_time = std::chrono::system_clock::time_point{};
+
+  const auto step = std::chrono::duration_cast<
+      std::chrono::system_clock::duration>(
+      std::chrono::duration<float>(settings.length / frames));
+
+  const auto before = allocation_count.load();
+  auto time = settings.start_time;
+  const auto ms = time_ms([&]() {
+    for (std::size_t i = 0; i < frames; ++i) {
+      pusn::animate(model, time);
+      time += step;
+    }
+  });
+  const auto allocations = allocation_count.load() - before;
+
+  std::printf("[animate] %zu frames\n", frames);
+  std::printf("  animate          %10.3f ms  %8.1f ns/frame\n", ms,
+              ms * 1e6 / frames);
+  std::printf("  heap allocations %zu\n", allocations);
+  return allocations == 0;
+}
+
+// bakes a 5 s move and plays it back frame by frame against the live
+// solve, returns false if playback allocated
+bool bench_baked_playback(std::size_t frames) {
+  pusn::internal::motion_state live;
+  auto &settings = live.current_settings.emplace();
+  settings.position_start = {10.f, 5.f, 10.f};
+  settings.position_end = {-5.f, 10.f, 20.f};
+  settings.quat_rotation_end = glm::quat(glm::vec3{0.5f, 1.f, 0.f});
+  settings.start_state = pusn::solve_task(live.left_puma,
+                                          {settings.position_start,
+                                           settings.quat_rotation_start})
+                             .states[0];
+  settings.end_state = settings.start_state;
+  settings.start_time = std::chrono::system_clock::time_point{};
+  live.right_puma = settings.start_state;
+  auto baked = live;
+
+  pusn::trajectory_baker baker;
+  const auto bake_ms = time_ms([&]() {
+    baked.trajectory =
+        baker.bake(settings, baked.left_puma, baked.right_puma);
+    while (!baked.trajectory->complete()) {
+      std::this_thread::yield();
+    }
+  });
+
+  const auto step = std::chrono::duration_cast<
+      std::chrono::system_clock::duration>(
+      std::chrono::duration<float>(settings.length / frames));
+
+  auto time = settings.start_time;
+  const auto live_ms = time_ms([&]() {
+    for (std::size_t i = 0; i < frames; ++i) {
+      pusn::animate(live, time);
+      time += step;
+    }
+  });
+
+  // same frames again, compared against the live states
+  float max_deviation = 0.f;
+  auto check = live;
+  check.current_settings = settings;
+  check.right_puma = settings.start_state;
+  check.right_puma_tracking.reset();
+  time = settings.start_time;
+  for (std::size_t i = 0; i < frames; ++i) {
+    pusn::animate(check, time);
+    auto playback = baked;
+    playback.trajectory->sample(
+        std::chrono::duration<float>(time - settings.start_time).count(),
+        playback);
+    max_deviation =
+        std::max(max_deviation, pusn::internal::state_dist(
+                                    check.right_puma, playback.right_puma));
+    time += step;
+  }
+
+  const auto before = allocation_count.load();
+  time = settings.start_time;
+  const auto playback_ms = time_ms([&]() {
+    for (std::size_t i = 0; i < frames; ++i) {
+      pusn::animate(baked, time);
+      time += step;
+    }
+  });
+  const auto allocations = allocation_count.load() - before;
+
+  std::printf("[baked playback] 5 s move, %zu samples, %zu frames\n",
+              baked.trajectory ? baked.trajectory->size() : 0, frames);
+  std::printf("  bake             %10.3f ms\n", bake_ms);
+  std::printf("  live animate     %10.3f ms  %8.1f ns/frame\n", live_ms,
+              live_ms * 1e6 / frames);
+  std::printf("  baked animate    %10.3f ms  %8.1f ns/frame  (x%.2f)\n",
+              playback_ms, playback_ms * 1e6 / frames, live_ms / playback_ms);
+  std::printf("  max deviation    %g\n", max_deviation);
+  std::printf("  heap allocations %zu\n", allocations);
+  return allocations == 0;
+}
+
+// plays a seeded program of short segments at 10x real time while the
+// runner prepares segments ahead, returns false if playback ever had to
+// wait for one
+bool bench_program(std::uint32_t seed) {
+  constexpr std::size_t segments = 200;
+  constexpr float segment_length = 0.05f;
+
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> offset(-1.5f, 1.5f);
+  std::uniform_real_distribution<float> angle(-0.1f, 0.1f);
+  std::vector<pusn::internal::waypoint> waypoints;
+  waypoints.reserve(segments + 1);
+  for (std::size_t i = 0; i <= segments; ++i) {
+    waypoints.push_back(
+        {glm::vec3{10.f + offset(rng), 5.f + offset(rng), 10.f + offset(rng)},
+         glm::quat(glm::vec3{angle(rng), angle(rng), angle(rng)}),
+         segment_length});
+  }
+
+  pusn::internal::motion_state motion;
+  auto program = std::make_shared<pusn::program_runner>(
+      std::move(waypoints), motion.left_puma,
+      pusn::internal::simulation_settings{});
+  program->start();
+
+  pusn::prepared_segment first;
+  while (!program->next(first)) {
+    std::this_thread::yield();
+  }
+  auto clock = pusn::sim_clock::fixed_step();
+  motion.current_settings = first.settings;
+  motion.current_settings->start_time = clock.now();
+  motion.trajectory = std::move(first.trajectory);
+  motion.program = program;
+
+  // one 1 ms tick every 100 us of wall time
+  using steady = std::chrono::steady_clock;
+  const auto wall_step = std::chrono::microseconds(100);
+  auto next_tick = steady::now();
+  std::size_t ticks = 0;
+  double total_ns = 0.0;
+  double max_transition_ns = 0.0;
+  // largest joint space jump of the IK robot between two ticks, a branch
+  // switch at a waypoint would show up here
+  float max_joint_step = 0.f;
+  auto previous = motion.right_puma;
+  while (motion.current_settings) {
+    const auto segment = program->handed_out.load();
+    const auto begin = steady::now();
+    pusn::animate(motion, clock.now());
+    const double ns =
+        std::chrono::duration<double, std::nano>(steady::now() - begin)
+            .count();
+    total_ns += ns;
+    if (program->handed_out.load() != segment) {
+      max_transition_ns = std::max(max_transition_ns, ns);
+    }
+    if (ticks > 0) {
+      max_joint_step = std::max(max_joint_step,
+                                pusn::internal::state_dist(previous,
+                                                           motion.right_puma));
+    }
+    previous = motion.right_puma;
+    ++ticks;
+    clock.advance();
+    next_tick += wall_step;
+    std::this_thread::sleep_until(next_tick);
+  }
+
+  std::printf("[program] %zu segments of %.0f ms, 10x real time\n", segments,
+              segment_length * 1e3f);
+  std::printf("  animate          %8.1f ns/tick over %zu ticks\n",
+              total_ns / ticks, ticks);
+  std::printf("  transition max   %8.1f ns\n", max_transition_ns);
+  std::printf("  max joint step   %g\n", max_joint_step);
+  std::printf("  unreachable      %zu\n", program->unreachable.load());
+  std::printf("  underrun ticks   %zu\n", program->underruns.load());
+  return program->underruns.load() == 0;
+}
+
+// parses the sample programs over and over, from the mapped files and
+// from memory
+void bench_gcode(std::size_t repeat) {
+  const std::filesystem::path root = "resources/programs";
+  std::vector<std::filesystem::path> files;
+  std::error_code ec;
+  for (const auto &entry :
+       std::filesystem::recursive_directory_iterator(root, ec)) {
+    if (entry.is_regular_file()) {
+      files.push_back(entry.path());
+    }
+  }
+  if (files.empty()) {
+    std::printf("[gcode] no programs under %s, skipped\n",
+                root.string().c_str());
+    return;
+  }
+
+  std::vector<std::string> texts;
+  std::size_t bytes = 0;
+  for (const auto &f : files) {
+    std::ifstream ifs(f, std::ios::binary);
+    texts.emplace_back(std::istreambuf_iterator<char>{ifs},
+                       std::istreambuf_iterator<char>{});
+    bytes += texts.back().size();
+  }
+
+  const pusn::gcode_settings settings;
+  std::vector<pusn::internal::waypoint> waypoints;
+  std::string error;
+  std::size_t moves = 0;
+  bool ok = true;
+
+  const auto load_ms = time_ms([&]() {
+    for (std::size_t r = 0; r < repeat; ++r) {
+      for (const auto &f : files) {
+        waypoints.clear();
+        ok &= pusn::load_gcode(f, settings, waypoints, error);
+        moves += waypoints.size();
+      }
+    }
+  });
+  const auto parse_ms = time_ms([&]() {
+    for (std::size_t r = 0; r < repeat; ++r) {
+      for (const auto &t : texts) {
+        waypoints.clear();
+        ok &= pusn::parse_gcode(t, settings, waypoints, error);
+      }
+    }
+  });
+
+  const double mb = static_cast<double>(bytes) * repeat / (1024.0 * 1024.0);
+  std::printf("[gcode] %zu programs, %zu bytes, %zu moves, x%zu\n",
+              files.size(), bytes, moves / repeat, repeat);
+  std::printf("  load_gcode       %10.3f ms  %8.1f MB/s\n", load_ms,
+              mb / (load_ms * 1e-3));
+  std::printf("  parse_gcode      %10.3f ms  %8.1f MB/s\n", parse_ms,
+              mb / (parse_ms * 1e-3));
+  if (!ok) {
+    std::printf("  error: %s\n", error.c_str());
+  }
+}
+
+// streams the largest sample program through a program_runner and takes
+// segments off as fast as they come, so the worker runs flat out: the ratio
+// of program time to preparation time is how far ahead of real time
+// playback can run before it underruns
+bool bench_streaming() {
+  const std::filesystem::path path = "resources/programs/paths2/4.k08";
+  auto stream = std::make_shared<pusn::gcode_stream>(
+      path, pusn::gcode_settings{});
+  if (!stream->is_open()) {
+    std::printf("[streaming] %s, skipped\n", stream->error().c_str());
+    return true;
+  }
+
+  pusn::internal::motion_state motion;
+  pusn::program_runner program(
+      [stream](pusn::internal::waypoint &w) { return (*stream)(w); },
+      motion.left_puma, pusn::internal::simulation_settings{});
+
+  std::size_t segments = 0;
+  std::size_t max_in_flight = 0;
+  double program_s = 0.0;
+  const auto ms = time_ms([&]() {
+    program.start();
+    pusn::prepared_segment segment;
+    while (!program.done()) {
+      if (!program.next(segment)) {
+        std::this_thread::yield();
+        continue;
+      }
+      ++segments;
+      program_s += segment.settings.length;
+      // read off the ring itself, the prepared counter trails the push
+      max_in_flight = std::max(max_in_flight, program.in_flight());
+    }
+  });
+
+  std::printf("[streaming] %s, %zu bytes, %zu segments\n",
+              path.string().c_str(), stream->size, segments);
+  std::printf("  prepare          %10.3f ms  for %.1f s of program  "
+              "(x%.1f real time)\n",
+              ms, program_s, program_s * 1e3 / ms);
+  std::printf("  in flight max    %zu  (lookahead %zu)\n", max_in_flight,
+              pusn::program_runner::lookahead);
+  std::printf("  unreachable      %zu\n", program.unreachable.load());
+  if (!stream->error().empty()) {
+    std::printf("  error: %s\n", stream->error().c_str());
+  }
+  return stream->error().empty() &&
+         max_in_flight <= pusn::program_runner::lookahead;
+}
+
+// streams a generated program a few release chunks long, so consumed
+// pages are given back on the way, and compares the waypoints with
+// parse_gcode of the same text
+bool bench_stream_release() {
+  const auto path = std::filesystem::temp_directory_path() /
+                    "puma_bench_stream_release.k08";
+  std::string text;
+  for (std::size_t i = 0; text.size() < 3 * pusn::gcode_stream::release_chunk;
+       ++i) {
+    char line[64];
+    std::snprintf(line, sizeof(line), "N%zuG01X%.3fY%.3fZ%.3f\n", i,
+                  std::sin(i * 1e-3) * 50.0, std::cos(i * 1e-3) * 50.0,
+                  20.0 + static_cast<double>(i % 100) * 0.1);
+    text += line;
+  }
+  {
+    std::ofstream out(path, std::ios::binary);
+    out.write(text.data(), static_cast<std::streamsize>(text.size()));
+  }
+
+  std::vector<pusn::internal::waypoint> expected;
+  std::string error;
+  pusn::parse_gcode(text, pusn::gcode_settings{}, expected, error);
+
+  std::size_t waypoints = 0;
+  std::size_t mismatches = 0;
+  std::size_t released = 0;
+  const auto ms = time_ms([&]() {
+    pusn::gcode_stream stream(path, pusn::gcode_settings{});
+    pusn::internal::waypoint w;
+    while (stream(w)) {
+      if (waypoints >= expected.size() ||
+          w.position != expected[waypoints].position) {
+        ++mismatches;
+      }
+      ++waypoints;
+    }
+    released = stream.bytes_released.load();
+    if (!stream.error().empty()) {
+      error = stream.error();
+    }
+  });
+  std::filesystem::remove(path);
+
+  std::printf("[stream release] %zu bytes, %zu waypoints, %.3f ms\n",
+              text.size(), waypoints, ms);
+  std::printf("  released         %zu bytes  (chunk %zu)\n", released,
+              pusn::gcode_stream::release_chunk);
+  std::printf("  mismatches       %zu\n", mismatches);
+  if (!error.empty()) {
+    std::printf("  error: %s\n", error.c_str());
+  }
+  return error.empty() && mismatches == 0 &&
+         waypoints == expected.size() &&
+         released + pusn::gcode_stream::release_chunk >= text.size();
+}
+
+// plays a whole move through run_motion on an as_fast_as_possible clock
+// twice, returns false if the two runs did not end in the same state
+bool bench_batch_run() {
+  auto make_motion = []() {
+    pusn::internal::motion_state motion;
+    auto &settings = motion.current_settings.emplace();
+    settings.length = 5.f;
+    settings.position_start = {10.f, 5.f, 10.f};
+    settings.position_end = {-5.f, 10.f, 20.f};
+    settings.quat_rotation_end = glm::quat(glm::vec3{0.5f, 1.f, 0.f});
+    settings.start_state = pusn::solve_task(motion.left_puma,
+                                            {settings.position_start,
+                                             settings.quat_rotation_start})
+                               .states[0];
+    settings.end_state = settings.start_state;
+    return motion;
+  };
+
+  auto first = make_motion();
+  auto second = make_motion();
+  std::uint64_t ticks = 0;
+  const auto ms = time_ms([&]() {
+    auto clock = pusn::sim_clock::as_fast_as_possible();
+    ticks = pusn::run_motion(first, clock);
+  });
+  auto clock = pusn::sim_clock::as_fast_as_possible();
+  pusn::run_motion(second, clock);
+
+  const bool identical =
+      std::memcmp(&first.left_puma, &second.left_puma,
+                  sizeof(first.left_puma)) == 0 &&
+      std::memcmp(&first.right_puma, &second.right_puma,
+                  sizeof(first.right_puma)) == 0;
+
+  std::printf("[batch run] 5 s move, 1 ms steps\n");
+  std::printf("  run_motion       %10.3f ms  %8zu ticks\n", ms,
+              static_cast<std::size_t>(ticks));
+  std::printf("  speedup          %10.1fx real time\n", 5000.0 / ms);
+  std::printf("  reproducible     %s\n", identical ? "yes" : "no");
+  return identical;
+}
+
+// fixed hot-path set, every path is timed over the same seeded inputs so
+// runs of different commits can be compared (the JSON output is meant to
+// be diffed)
+namespace hot {
+
+struct options {
+  std::size_t count{50000};
+  std::size_t warmup{1};
+  std::size_t repeat{5};
+  std::uint32_t seed{1234};
+  std::string json;
+  bool sections{true};
+};
+
+struct result {
+  const char *name;
+  std::size_t ops;
+  double min_ns;
+  double median_ns;
+  double ops_per_s;
+};
+
+// results are folded in here so the optimizer cannot drop the work
+volatile double sink = 0.0;
+
+// body runs all ops once and returns a checksum of what it computed
+template <typename Body>
+result measure(const char *name, std::size_t ops, const options &opt,
+               Body &&body) {
+  for (std::size_t i = 0; i < opt.warmup; ++i) {
+    sink = sink + body();
+  }
+  std::vector<double> ns_per_op;
+  for (std::size_t i = 0; i < std::max<std::size_t>(opt.repeat, 1); ++i) {
+    double checksum = 0.0;
+    const auto ms = time_ms([&]() { checksum = body(); });
+    sink = sink + checksum;
+    ns_per_op.push_back(ms * 1e6 / ops);
+  }
+  std::sort(ns_per_op.begin(), ns_per_op.end());
+  const auto median = ns_per_op[ns_per_op.size() / 2];
+  return {name, ops, ns_per_op.front(), median, 1e9 / median};
+}
+
+std::vector<glm::quat> random_quats(std::size_t count, std::uint32_t seed) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<float> angle(0.f, 2 * glm::pi<float>());
+  std::vector<glm::quat> ret(count);
+  for (auto &q : ret) {
+    q = glm::quat(glm::vec3{angle(gen), angle(gen), angle(gen)});
+  }
+  return ret;
+}
+
+std::vector<float> random_floats(std::size_t count, std::uint32_t seed,
+                                 float min, float max) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<float> dist(min, max);
+  std::vector<float> ret(count);
+  for (auto &v : ret) {
+    v = dist(gen);
+  }
+  return ret;
+}
+
+std::vector<result> run(const options &opt) {
+  const auto n = opt.count;
+  const pusn::internal::puma_state robot;
+  const auto poses = random_poses(n, opt.seed);
+  const auto states_a = random_states(n, opt.seed + 1);
+  const auto states_b = random_states(n, opt.seed + 2);
+  const auto quats_a = random_quats(n, opt.seed + 3);
+  const auto quats_b = random_quats(n, opt.seed + 4);
+  const auto ts = random_floats(n, opt.seed + 5, 0.f, 1.f);
+  const auto coords = random_floats(3 * n, opt.seed + 6, -20.f, 20.f);
+
+  std::vector<result> ret;
+
+  ret.push_back(measure("solve_task", n, opt, [&]() {
+    double sum = 0.0;
+    for (const auto &p : poses) {
+      sum += pusn::solve_task(robot, p).valid_mask;
+    }
+    return sum;
+  }));
+
+  ret.push_back(measure("get_actuator_pos", n, opt, [&]() {
+    double sum = 0.0;
+    for (const auto &s : states_a) {
+      sum += pusn::get_actuator_pos(s).x;
+    }
+    return sum;
+  }));
+
+  ret.push_back(measure("internal::lerp", n, opt, [&]() {
+    double sum = 0.0;
+    for (std::size_t i = 0; i < n; ++i) {
+      sum += pusn::internal::lerp(states_a[i], states_b[i], ts[i]).alpha_3;
+    }
+    return sum;
+  }));
+
+  ret.push_back(measure("internal::state_dist", n, opt, [&]() {
+    double sum = 0.0;
+    for (std::size_t i = 0; i < n; ++i) {
+      sum += pusn::internal::state_dist(states_a[i], states_b[i]);
+    }
+    return sum;
+  }));
+
+  ret.push_back(measure("math::slerp", n, opt, [&]() {
+    double sum = 0.0;
+    for (std::size_t i = 0; i < n; ++i) {
+      sum += math::slerp(quats_a[i], quats_b[i], ts[i]).w;
+    }
+    return sum;
+  }));
+
+  ret.push_back(measure("math::get_model_matrix", n, opt, [&]() {
+    double sum = 0.0;
+    for (std::size_t i = 0; i < n; ++i) {
+      const glm::vec3 v{coords[3 * i], coords[3 * i + 1], coords[3 * i + 2]};
+      sum += math::get_model_matrix(v, glm::vec3{1.f + ts[i]}, v * 0.1f)[3][0];
+    }
+    return sum;
+  }));
+
+  // a whole cylinder per op, so far fewer of them
+  const auto meshes = std::max<std::size_t>(n / 500, 1);
+  std::vector<pusn::pos_norm_col> vertices;
+  std::vector<unsigned int> indices;
+  ret.push_back(
+      measure("mock_data::build_vertices_helper", meshes, opt, [&]() {
+        double sum = 0.0;
+        for (std::size_t i = 0; i < meshes; ++i) {
+          vertices.clear();
+          indices.clear();
+          mock_data::build_vertices_helper(50, 1.f + 10.f * ts[i], 1.f,
+                                           vertices, indices,
+                                           glm::mat4(1.f));
+          sum += vertices.size() + indices.size();
+        }
+        return sum;
+      }));
+
+  return ret;
+}
+
+struct environment {
+  std::string compiler;
+  long cplusplus;
+  bool optimized;
+  bool assertions;
+  int omp_threads;
+  unsigned hardware_threads;
+  const char *os;
+};
+
+environment detect_environment() {
+  environment env;
+#if defined(__clang__)
+  env.compiler = std::string("clang ") + __clang_version__;
+#elif defined(__GNUC__)
+  env.compiler = std::string("gcc ") + __VERSION__;
+#elif defined(_MSC_VER)
+  env.compiler = "msvc " + std::to_string(_MSC_VER);
+#else
+  env.compiler = "unknown";
+#endif
+  env.cplusplus = static_cast<long>(__cplusplus);
+#if defined(__OPTIMIZE__) || (defined(_MSC_VER) && defined(NDEBUG))
+  env.optimized = true;
+#else
+  env.optimized = false;
+#endif
+#ifdef NDEBUG
+  env.assertions = false;
+#else
+  env.assertions = true;
+#endif
+#ifdef _OPENMP
+  env.omp_threads = omp_get_max_threads();
+#else
+  env.omp_threads = 0;
+#endif
+  env.hardware_threads = std::thread::hardware_concurrency();
+#if defined(_WIN32)
+  env.os = "windows";
+#elif defined(__APPLE__)
+  env.os = "macos";
+#elif defined(__linux__)
+  env.os = "linux";
+#else
+  env.os = "unknown";
+#endif
+  return env;
+}
+
+void print(const environment &env, const options &opt,
+           const std::vector<result> &results) {
+  std::printf("[environment]\n");
+  std::printf("  compiler         %s (C++ %ld)\n", env.compiler.c_str(),
+              env.cplusplus);
+  std::printf("  optimized %s, assertions %s, os %s\n",
+              env.optimized ? "yes" : "no", env.assertions ? "on" : "off",
+              env.os);
+  std::printf("  threads          %u hardware, %d OpenMP\n",
+              env.hardware_threads, env.omp_threads);
+  std::printf("  seed %u, count %zu, warmup %zu, repeat %zu\n", opt.seed,
+              opt.count, opt.warmup, opt.repeat);
+
+  std::printf("[hot paths] median of %zu\n", opt.repeat);
+  for (const auto &r : results) {
+    std::printf("  %-34s %10.1f ns/op  %14.0f ops/s  (min %.1f ns)\n",
+                r.name, r.median_ns, r.ops_per_s, r.min_ns);
+  }
+}
+
+// escapes the few characters compiler version strings could contain
+std::string json_string(std::string_view s) {
+  std::string ret = "\"";
+  for (auto c : s) {
+    if (c == '"' || c == '\\') {
+      ret += '\\';
+    }
+    ret += (c == '\n' || c == '\t') ? ' ' : c;
+  }
+  return ret + "\"";
+}
+
+bool write_json(const std::string &path, const environment &env,
+                const options &opt, const std::vector<result> &results) {
+  std::FILE *f = std::fopen(path.c_str(), "w");
+  if (!f) {
+    return false;
+  }
+  std::fprintf(f, "{\n  \"environment\": {\n");
+  std::fprintf(f, "    \"compiler\": %s,\n",
+               json_string(env.compiler).c_str());
+  std::fprintf(f, "    \"cplusplus\": %ld,\n", env.cplusplus);
+  std::fprintf(f, "    \"optimized\": %s,\n",
+               env.optimized ? "true" : "false");
+  std::fprintf(f, "    \"assertions\": %s,\n",
+               env.assertions ? "true" : "false");
+  std::fprintf(f, "    \"os\": \"%s\",\n", env.os);
+  std::fprintf(f, "    \"hardware_threads\": %u,\n", env.hardware_threads);
+  std::fprintf(f, "    \"omp_threads\": %d\n  },\n", env.omp_threads);
+  std::fprintf(f,
+               "  \"options\": {\"seed\": %u, \"count\": %zu, "
+               "\"warmup\": %zu, \"repeat\": %zu},\n",
+               opt.seed, opt.count, opt.warmup, opt.repeat);
+  std::fprintf(f, "  \"hot_paths\": [\n");
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const auto &r = results[i];
+    std::fprintf(f,
+                 "    {\"name\": \"%s\", \"ops\": %zu, "
+                 "\"median_ns_per_op\": %.3f, \"min_ns_per_op\": %.3f, "
+                 "\"ops_per_s\": %.1f}%s\n",
+                 r.name, r.ops, r.median_ns, r.min_ns, r.ops_per_s,
+                 i + 1 < results.size() ? "," : "");
+  }
+  std::fprintf(f, "  ]\n}\n");
+  return std::fclose(f) == 0;
+}
+
+bool parse(int argc, char **argv, options &opt) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--count" && has_value) {
+      opt.count = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--warmup" && has_value) {
+      opt.warmup = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--repeat" && has_value) {
+      opt.repeat = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--seed" && has_value) {
+      opt.seed = static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--json" && has_value) {
+      opt.json = argv[++i];
+    } else if (arg == "--hot-paths-only") {
+      opt.sections = false;
+    } else if (!arg.empty() && arg[0] != '-') {
+      // bare number, the count the bench used to take
+      opt.count = std::strtoull(argv[i], nullptr, 10);
+    } else {
+      return false;
+    }
+  }
+  opt.count = std::max<std::size_t>(opt.count, 1);
+  return true;
+}
+
+} // namespace hot
+
+} // namespace
+
+int main(int argc, char **argv) {
+  hot::options opt;
+  if (!hot::parse(argc, argv, opt)) {
+    std::fprintf(stderr,
+                 "usage: puma_bench [--count N] [--warmup N] [--repeat N] "
+                 "[--seed S] [--json FILE] [--hot-paths-only]\n");
+    return 2;
+  }
+
+  const auto env = hot::detect_environment();
+  const auto results = hot::run(opt);
+  hot::print(env, opt, results);
+  if (!opt.json.empty() && !hot::write_json(opt.json, env, opt, results)) {
+    std::fprintf(stderr, "could not write %s\n", opt.json.c_str());
+    return 1;
+  }
+
+  if (!opt.sections) {
+    return 0;
+  }
+  const auto count = opt.count;
+  bench_fk(count);
+  const bool ik = bench_ik(count);
+  bench_tracking(count);
+  bench_refine(count);
+  bench_cache(count);
+  const bool reproducible = bench_batch_run();
+  const bool playback = bench_baked_playback(count);
+  bench_gcode(std::max<std::size_t>(count / 1000, 1));
+  const bool program = bench_program(opt.seed);
+  const bool streaming = bench_streaming();
+  const bool stream_release = bench_stream_release();
+  return bench_animation_allocations(count) && ik && reproducible &&
+                 playback && program && streaming && stream_release
+             ? 0
+             : 1;
+}
@@ -0,0 +1,71 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+#include <reachability.hpp>
+
+// precomputes the reachability volume of the default robot for the cube
+// orientations and writes it where the GUI looks for it
+//    puma_reachability [output] [resolution] [half extent]
+
+int main(int argc, char **argv) {
+  const std::string output =
+      argc > 1 ? argv[1] : "resources/reachability.bin";
+  const int resolution = argc > 2 ? std::atoi(argv[2]) : 48;
+  const float extent = argc > 3 ? std::strtof(argv[3], nullptr) : 30.f;
+
+  pusn::internal::puma_state robot;
+  const auto orientations = pusn::cube_orientations();
+  const glm::vec3 min{-extent, -extent, robot.l1 - extent};
+  const glm::vec3 max{extent, extent, robot.l1 + extent};
+
+  const auto start = std::chrono::steady_clock::now();
+  const auto volume = pusn::reachability_volume::compute(
+      robot, min, max, glm::ivec3(resolution), orientations);
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  if (!volume.save(output)) {
+    std::fprintf(stderr, "could not write %s\n", output.c_str());
+    return 1;
+  }
+
+  const auto loaded = pusn::reachability_volume::load(output);
+  if (!loaded) {
+    std::fprintf(stderr, "could not map %s back\n", output.c_str());
+    return 1;
+  }
+
+  // compare the mapped volume against IK on random cell centers
+  std::mt19937 gen(5u);
+  std::uniform_int_distribution<int> cell(0, resolution - 1);
+  std::uniform_int_distribution<std::size_t> orientation(
+      0, orientations.size() - 1);
+  const glm::vec3 cell_size = (max - min) / static_cast<float>(resolution);
+  std::size_t reachable = 0;
+  std::size_t mismatches = 0;
+  const std::size_t samples = 10000;
+  for (std::size_t i = 0; i < samples; ++i) {
+    const auto o = orientation(gen);
+    const glm::vec3 pos =
+        min + cell_size * (glm::vec3(cell(gen), cell(gen), cell(gen)) + 0.5f);
+    const auto count = loaded->branch_count(pos, o);
+    reachable += count > 0;
+    mismatches +=
+        count != pusn::solve_task(robot, {pos, orientations[o]}).size();
+  }
+
+  const auto entries = static_cast<std::size_t>(resolution) * resolution *
+                       resolution * orientations.size();
+  std::printf("%d^3 cells x %zu orientations in %.2f s (%.0f poses/s)\n",
+              resolution, orientations.size(), elapsed.count(),
+              entries / elapsed.count());
+  std::printf("wrote %s, %zu bytes\n", output.c_str(),
+              entries + sizeof(pusn::reachability_header) +
+                  orientations.size() * 4 * sizeof(float));
+  std::printf("sampled %zu poses: %.1f%% reachable, %zu mismatches vs IK\n",
+              samples, 100.0 * reachable / samples, mismatches);
+  return mismatches == 0 ? 0 : 1;
+}
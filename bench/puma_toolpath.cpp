@@ -0,0 +1,102 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+
+#include <gcode.hpp>
+#include <motion_program.hpp>
+#include <toolpath.hpp>
+
+// compiles a G-code program for the default robot and placement into a
+// .pumapath file next to it, then times loading it against parsing and
+// solving the G-code again
+//    puma_toolpath program [output]
+
+namespace {
+
+template <typename F> double time_ms(F &&f) {
+  const auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::fprintf(stderr, "usage: puma_toolpath program [output]\n");
+    return 2;
+  }
+  const std::filesystem::path input = argv[1];
+  auto output = input;
+  output.replace_extension(".pumapath");
+  if (argc > 2) {
+    output = argv[2];
+  }
+
+  const pusn::internal::puma_state robot;
+  const pusn::gcode_settings settings;
+
+  std::vector<pusn::internal::waypoint> waypoints;
+  std::string error;
+  if (!pusn::load_gcode(input, settings, waypoints, error)) {
+    std::fprintf(stderr, "%s: %s\n", input.string().c_str(), error.c_str());
+    return 1;
+  }
+
+  const auto compiled = pusn::compiled_toolpath::compile(robot, waypoints);
+  if (!compiled.save(output)) {
+    std::fprintf(stderr, "could not write %s\n", output.string().c_str());
+    return 1;
+  }
+
+  // what the app does without the compiled file
+  std::vector<pusn::internal::puma_state> solved;
+  const auto text_ms = time_ms([&]() {
+    waypoints.clear();
+    pusn::load_gcode(input, settings, waypoints, error);
+    solved.resize(waypoints.size());
+    pusn::ik_cache cache;
+    auto previous = robot;
+    for (std::size_t i = 0; i < waypoints.size(); ++i) {
+      pusn::solve_waypoint(cache, robot, waypoints[i], previous, solved[i]);
+      previous = solved[i];
+    }
+  });
+
+  std::optional<pusn::compiled_toolpath> loaded;
+  std::vector<pusn::internal::waypoint> loaded_waypoints;
+  std::vector<pusn::internal::puma_state> loaded_states;
+  const auto binary_ms = time_ms([&]() {
+    loaded = pusn::compiled_toolpath::load(output);
+    if (loaded && loaded->matches(robot)) {
+      loaded_waypoints = loaded->waypoints();
+      loaded_states = loaded->states(robot);
+    }
+  });
+  if (!loaded || loaded_states.size() != solved.size()) {
+    std::fprintf(stderr, "could not load %s back\n", output.string().c_str());
+    return 1;
+  }
+
+  // the compiled joints have to be the ones the app would solve
+  std::size_t mismatches = 0;
+  for (std::size_t i = 0; i < solved.size(); ++i) {
+    mismatches += std::memcmp(&solved[i], &loaded_states[i],
+                              sizeof(solved[i])) != 0;
+  }
+
+  std::printf("%zu waypoints, %zu unreachable, wrote %s (%ju bytes)\n",
+              compiled.size(), compiled.unreachable(),
+              output.string().c_str(),
+              static_cast<std::uintmax_t>(std::filesystem::file_size(output)));
+  std::printf("G-code parse + IK  %10.3f ms\n", text_ms);
+  std::printf("compiled load      %10.3f ms  (x%.1f)\n", binary_ms,
+              text_ms / binary_ms);
+  std::printf("%zu joint mismatches\n", mismatches);
+  return mismatches == 0 ? 0 : 1;
+}
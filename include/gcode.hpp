@@ -0,0 +1,125 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <interpolator_scene.hpp>
+#include <utils.hpp>
+
+namespace pusn {
+
+// how the tool path of a milling program is placed in front of the robot.
+// Program coordinates are millimeters with Z up, every point becomes
+// offset + scale * (X, Z, -Y) in the scene, reached with the tool held at
+// tool_rotation
+struct gcode_settings {
+  float scale{0.05f};
+  math::vec3 offset{12.f, 2.f, 0.f};
+  glm::quat tool_rotation{1.f, 0.f, 0.f, 0.f};
+
+  // program units per second for G01 (until an F word changes it) and G00
+  float feed_rate{50.f};
+  float rapid_rate{200.f};
+};
+
+struct gcode_stats {
+  std::size_t bytes{0};
+  std::size_t lines{0};
+  // moves that did not go anywhere are dropped
+  std::size_t skipped_moves{0};
+};
+
+// pulls the moves of a program out of text one waypoint at a time, in the
+// same way parse_gcode does. text has to outlive the reader
+struct gcode_reader {
+  gcode_reader(std::string_view text, const gcode_settings &settings);
+
+  // the next waypoint, false at the end of the text or on a malformed line
+  // (error() then names it)
+  bool next(internal::waypoint &out);
+
+  inline bool failed() const { return !message.empty(); }
+  inline const std::string &error() const { return message; }
+  inline const gcode_stats &stats() const { return counters; }
+  // bytes of text read so far
+  inline std::size_t consumed() const {
+    return static_cast<std::size_t>(it - text.data());
+  }
+
+private:
+  bool fail(std::string_view what);
+
+  std::string_view text;
+  gcode_settings settings;
+  const char *it;
+  gcode_stats counters;
+  std::string message;
+
+  // modal state carried from line to line
+  math::vec3 position{0.f, 0.f, 0.f};
+  int motion{-1};
+  float feed_rate;
+  bool has_position{false};
+};
+
+// parses G00 / G01 moves with modal X, Y, Z (an axis missing from a line
+// keeps its previous value) into waypoints for program_runner, the first
+// one being the first point of the program. Nothing is copied out of text,
+// numbers are read in place. On a malformed line returns false with error
+// naming it, out then holds the moves before it
+bool parse_gcode(std::string_view text, const gcode_settings &settings,
+                 std::vector<internal::waypoint> &out, std::string &error,
+                 gcode_stats *stats = nullptr);
+
+// parse_gcode straight from the memory mapped file
+bool load_gcode(const std::filesystem::path &path,
+                const gcode_settings &settings,
+                std::vector<internal::waypoint> &out, std::string &error,
+                gcode_stats *stats = nullptr);
+
+// a G-code file read as it is played: the file is mapped and read once
+// front to back by program_runner's worker (use it as its waypoint_source),
+// pages already read are dropped again, so a program of any size takes no
+// more memory than the runner's lookahead
+struct gcode_stream {
+  gcode_stream(const std::filesystem::path &path,
+               const gcode_settings &settings);
+
+  gcode_stream(const gcode_stream &) = delete;
+  gcode_stream &operator=(const gcode_stream &) = delete;
+
+  // reader side, false at the end of the file or on an error
+  bool operator()(internal::waypoint &out);
+
+  // false if the file could not be opened, error() says why
+  inline bool is_open() const { return reader.has_value(); }
+  // the stream ended, on an error when error() is not empty. Safe to ask
+  // from any thread, error() only after finished()
+  inline bool finished() const {
+    return done.load(std::memory_order_acquire);
+  }
+  inline const std::string &error() const { return message; }
+
+  // consumed pages are given back every this many bytes
+  static constexpr std::size_t release_chunk = std::size_t{1} << 20;
+
+  // progress, safe to read from any thread
+  std::atomic<std::size_t> bytes_read{0};
+  // bytes at the front of the file whose pages were given back
+  std::atomic<std::size_t> bytes_released{0};
+  std::size_t size{0};
+
+private:
+  utils::mapped_file file;
+  std::optional<gcode_reader> reader;
+  std::string message;
+  std::atomic<bool> done{false};
+  std::size_t released{0};
+};
+
+} // namespace pusn
@@ -6,6 +6,10 @@
 
 #include <glfw_impl/common.hpp>
 #include <glfw_impl/framebuffer.hpp>
+#include <glfw_impl/merged_mesh.hpp>
+#include <glfw_impl/program_cache.hpp>
+#include <glfw_impl/program_registry.hpp>
+#include <glfw_impl/uniform.hpp>
 
 namespace pusn {
 
@@ -20,9 +24,12 @@ void swap_buffers(window_t &w);
 void poll_events(window_t &w);
 void fill_renderable(std::vector<pos_norm_col> &vertices,
                      std::vector<unsigned int> &indices, renderable &out);
+// the shared program of program_registry, linked (or taken from
+// program_cache) on first use
 void add_program_to_renderable(const std::string &program_name,
                                renderable &out);
 inline auto get_ticks() { return glfwGetTime(); }
+// glUseProgram through program_registry, redundant binds are skipped
 void use_program(GLuint program);
 void render(const renderable &meta, const api_agnostic_geometry &geom,
             render_mode mode = render_mode::triangles);
@@ -90,20 +97,6 @@ void fill_texture(texture_t &texture, int x, int y,
   }
 }
 
-template <typename UniformType>
-inline void set_uniform(const std::string &name, GLuint program,
-                        const UniformType &value) {
-  if constexpr (std::is_same_v<math::mat4, UniformType>) {
-    glUniformMatrix4fv(glGetUniformLocation(program, name.c_str()), 1, GL_FALSE,
-                       math::get_value_ptr(value));
-  }
-
-  if constexpr (std::is_same_v<math::vec3, UniformType>) {
-    glUniform3f(glGetUniformLocation(program, name.c_str()), value.x, value.y,
-                value.z);
-  }
-}
-
 // utils
 inline mouse_state::mouse_button mbutton_glfw_to_enum(int glfw_mbutton);
 
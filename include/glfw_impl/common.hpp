@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <memory>
 #include <optional>
 
@@ -22,6 +23,17 @@ struct texture_t {
   inline bool has_value() { return index.has_value(); }
 };
 
+// draw calls and state changes of a frame, counted by the glfw_impl calls
+// that make them (program binds are counted by program_registry)
+struct render_stats {
+  std::size_t draw_calls{0};
+  std::size_t vao_binds{0};
+  // glProgramUniform calls and uniform / storage buffer uploads
+  std::size_t uploads{0};
+};
+// the frame being rendered, before_frame moves it to last_frame_info
+inline render_stats frame_render_stats;
+
 struct last_frame_info {
   static unsigned int width;
   static unsigned int height;
@@ -34,6 +46,8 @@ struct last_frame_info {
 
   static float last_frame_time;
   static uint64_t begin_time;
+
+  static render_stats render;
 };
 
 struct key_mappings {
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <geometry.hpp>
+#include <glfw_impl/common.hpp>
+
+namespace pusn {
+
+namespace glfw_impl {
+
+// layout glMultiDrawElementsIndirect reads its commands in
+struct draw_elements_command {
+  GLuint count;
+  GLuint instance_count;
+  GLuint first_index;
+  GLint base_vertex;
+  GLuint base_instance;
+};
+
+// meshes packed into one vertex and one index buffer, each part remembered
+// by its first index and base vertex, every vertex also carries the index
+// of its part (attribute part_attribute). All parts - for one object or
+// for several copies of it - are drawn with a single
+// glMultiDrawElementsIndirect
+struct merged_mesh {
+  // shader storage binding of the model matrices
+  static constexpr GLuint matrices_binding = 1;
+  // unsigned int part index of the vertex
+  static constexpr GLuint part_attribute = 3;
+
+  struct part {
+    GLuint first_index;
+    GLuint count;
+    GLint base_vertex;
+  };
+
+  renderable meta;
+  std::vector<part> parts;
+
+  void clear();
+  // appends geometry as the next part and returns its index. A double
+  // sided part gets every triangle a second time reversed, so it survives
+  // back face culling
+  std::size_t add(const api_agnostic_geometry &geometry,
+                  bool double_sided = false);
+  // uploads every part added so far
+  void upload();
+  // one model matrix per part, in part order, for as many copies of the
+  // mesh as matrices holds. The vertex shader takes the matrix of each
+  // draw from the storage buffer indexed with gl_DrawID
+  void draw(std::span<const math::mat4> matrices);
+  // copies instances of every part and nothing else, the vertex shader
+  // places each vertex from its part index and gl_InstanceID
+  void draw_instanced(std::size_t copies);
+
+private:
+  void prepare_commands(std::size_t copies, bool instanced);
+  void submit(std::size_t commands);
+
+  std::vector<pos_norm_col> vertices;
+  std::vector<GLuint> vertex_parts;
+  std::vector<unsigned int> indices;
+
+  std::optional<GLuint> part_buffer;
+  std::optional<GLuint> command_buffer;
+  std::optional<GLuint> matrix_buffer;
+  // what the command buffer holds commands for
+  std::size_t command_copies{0};
+  bool instanced_commands{false};
+  std::size_t matrix_capacity{0};
+};
+
+} // namespace glfw_impl
+} // namespace pusn
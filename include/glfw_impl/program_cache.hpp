@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+
+#include <glfw_impl/common.hpp>
+
+namespace pusn {
+
+namespace glfw_impl {
+
+// linked program binaries kept on disk between runs, so startup does not
+// wait for the driver's compiler. An entry is keyed on the program's
+// sources and the driver that built it (vendor, renderer and version),
+// anything else the driver rejects is just compiled again
+//
+// entry layout, one file per key:
+//    program_binary_header
+//    size bytes of the binary in format
+struct program_binary_header {
+  char magic[8];
+  GLenum format;
+  std::uint32_t size;
+  // how long compiling and linking took when the entry was written
+  float link_ms;
+  std::uint32_t reserved;
+};
+
+struct program_cache {
+  static constexpr char magic[8] = {'P', 'U', 'M', 'A', 'P', 'B', 'I', 'N'};
+  static inline std::filesystem::path directory{"cache/programs"};
+
+  // FNV-1a over the sources of every stage and the driver strings, needs
+  // a current context
+  static std::uint64_t key(std::span<const std::string_view> sources);
+
+  // a linked program from the binary of an earlier run, nullopt if there
+  // is none or the driver does not take it anymore
+  static std::optional<GLuint> load(std::uint64_t key);
+  // keeps the binary of program, linked with
+  // GL_PROGRAM_BINARY_RETRIEVABLE_HINT in link_ms
+  static void store(std::uint64_t key, GLuint program, float link_ms);
+
+  // compile and link time the cache saved since startup
+  static inline float saved_ms() { return saved; }
+
+private:
+  static std::filesystem::path entry(std::uint64_t key);
+
+  static inline float saved{0.f};
+};
+
+} // namespace glfw_impl
+} // namespace pusn
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include <glfw_impl/common.hpp>
+
+namespace pusn {
+
+namespace glfw_impl {
+
+// linked shader programs by name (the sources without their stage
+// extension, "resources/model"). Each one is compiled and linked once and
+// shared by every renderable drawn with it, and the bound program is
+// remembered so binding it again does not reach the driver
+struct program_registry {
+  // a uniform of the default block as the linked program reports it
+  struct active_uniform {
+    GLint location{-1};
+    GLenum type{0};
+  };
+
+  struct entry {
+    GLuint program{0};
+    // read once after linking, see uniform<T>
+    std::unordered_map<std::string, active_uniform> uniforms;
+  };
+
+  // glUseProgram calls of a frame
+  struct stats {
+    std::size_t binds{0};
+    std::size_t skipped{0};
+  };
+
+  // the program linked from name, built on the first request
+  static GLuint acquire(const std::string &name);
+  // nullptr if program does not use name (or it was optimized out)
+  static const active_uniform *find_uniform(GLuint program,
+                                            const std::string &name);
+  static inline std::size_t size() { return programs.size(); }
+
+  // binds program unless it already is
+  static void use(GLuint program);
+  // starts counting a new frame; other renderers (ImGui) change the bound
+  // program in between, so the first use of a frame always binds
+  static void new_frame();
+
+  static inline const stats &last_frame() { return previous; }
+
+private:
+  static std::unordered_map<std::string, entry> programs;
+  static std::optional<GLuint> bound;
+  static stats current;
+  static stats previous;
+};
+
+} // namespace glfw_impl
+} // namespace pusn
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string>
+#include <type_traits>
+
+#include <glfw_impl/common.hpp>
+#include <glfw_impl/program_registry.hpp>
+#include <logger.hpp>
+
+namespace pusn {
+
+namespace glfw_impl {
+
+// GL type of the uniforms a uniform<T> can be bound to, only the types
+// set_uniform knows how to upload have one
+template <typename T> struct uniform_type;
+template <> struct uniform_type<math::mat4> {
+  static constexpr GLenum value = GL_FLOAT_MAT4;
+};
+template <> struct uniform_type<math::vec3> {
+  static constexpr GLenum value = GL_FLOAT_VEC3;
+};
+template <> struct uniform_type<bool> {
+  static constexpr GLenum value = GL_BOOL;
+};
+
+// a uniform of a linked program, resolved once by get_uniform. Setting it
+// is a single glProgramUniform call, no name lookup and no bound program
+// needed. A location of -1 (not used by the program) makes sets no-ops
+template <typename T> struct uniform {
+  GLuint program{0};
+  GLint location{-1};
+};
+
+template <typename T>
+uniform<T> get_uniform(GLuint program, const std::string &name) {
+  const auto *active = program_registry::find_uniform(program, name);
+  if (!active) {
+    return {program, -1};
+  }
+  if (active->type != uniform_type<T>::value) {
+    LOGGER_ERROR("[UNIFORM] {0} of program {1} has GL type {2:#x}", name,
+                 program, active->type);
+    return {program, -1};
+  }
+  return {program, active->location};
+}
+
+template <typename T>
+inline void set_uniform(const uniform<T> &u,
+                        const std::type_identity_t<T> &value) {
+  ++frame_render_stats.uploads;
+  if constexpr (std::is_same_v<math::mat4, T>) {
+    glProgramUniformMatrix4fv(u.program, u.location, 1, GL_FALSE,
+                              math::get_value_ptr(value));
+  }
+
+  if constexpr (std::is_same_v<math::vec3, T>) {
+    glProgramUniform3f(u.program, u.location, value.x, value.y, value.z);
+  }
+
+  if constexpr (std::is_same_v<bool, T>) {
+    glProgramUniform1i(u.program, u.location, value ? 1 : 0);
+  }
+}
+
+// a uniform block of std140 layout T kept in its own buffer, bound to a
+// fixed binding point the shaders name with layout(binding = ...)
+template <typename T> struct uniform_buffer {
+  std::optional<GLuint> buffer;
+
+  inline void create(GLuint binding) {
+    if (!buffer.has_value()) {
+      GLuint tmp;
+      glCreateBuffers(1, &tmp);
+      glNamedBufferStorage(tmp, sizeof(T), nullptr, GL_DYNAMIC_STORAGE_BIT);
+      buffer = tmp;
+    }
+    glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer.value());
+  }
+
+  inline void update(const T &value) {
+    ++frame_render_stats.uploads;
+    glNamedBufferSubData(buffer.value(), 0, sizeof(T), &value);
+  }
+};
+
+// an array of std430 layout T in a shader storage buffer bound to a fixed
+// binding point, grown as needed
+template <typename T> struct storage_buffer {
+  std::optional<GLuint> buffer;
+  std::size_t capacity{0};
+  GLuint binding{0};
+
+  inline void create(GLuint binding) {
+    if (!buffer.has_value()) {
+      GLuint tmp;
+      glCreateBuffers(1, &tmp);
+      buffer = tmp;
+    }
+    this->binding = binding;
+  }
+
+  inline void update(std::span<const T> values) {
+    if (values.size() > capacity) {
+      glNamedBufferData(buffer.value(), sizeof(T) * values.size(), nullptr,
+                        GL_DYNAMIC_DRAW);
+      capacity = values.size();
+    }
+    ++frame_render_stats.uploads;
+    glNamedBufferSubData(buffer.value(), 0, sizeof(T) * values.size(),
+                         values.data());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffer.value());
+  }
+};
+
+} // namespace glfw_impl
+} // namespace pusn
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <inverse_kinematics.hpp>
+
+namespace pusn {
+
+struct ik_cache_stats {
+  std::size_t hits{0};
+  std::size_t misses{0};
+  // misses that had to overwrite another entry because its probe window
+  // was full
+  std::size_t evictions{0};
+
+  inline double hit_rate() const {
+    const auto lookups = hits + misses;
+    return lookups ? static_cast<double>(hits) / lookups : 0.0;
+  }
+};
+
+// memoizes solve_task for tool paths that keep coming back to the same
+// poses (plunge/retract points, repeated passes). Poses are quantized -
+// position by position_step, the sign-normalized quaternion components by
+// rotation_step - and every pose falling into the same cell shares the
+// 8-branch result of the first one solved there.
+// Bounded open addressing with linear probing, nothing is allocated after
+// construction
+struct ik_cache {
+  explicit ik_cache(std::size_t capacity = 4096, float position_step = 1e-3f,
+                    float rotation_step = 1e-4f);
+
+  // solution set of the cell settings falls into, solved and stored on a
+  // miss. The reference stays valid until the next call
+  const ik_solutions &solve(const internal::puma_state &robot,
+                            const puma_pos &settings);
+
+  void clear();
+
+  // rounded up to a power of two
+  inline std::size_t capacity() const { return slots.size(); }
+  inline std::size_t size() const { return used; }
+  inline const ik_cache_stats &stats() const { return counters; }
+  inline void reset_stats() { counters = {}; }
+
+  inline float position_step() const { return pos_step; }
+  inline float rotation_step() const { return rot_step; }
+
+private:
+  // longest probe sequence before an entry is evicted
+  static constexpr std::size_t max_probe = 8;
+
+  using key = std::array<std::int32_t, 7>;
+
+  struct slot {
+    key k;
+    bool occupied{false};
+    ik_solutions solutions;
+  };
+
+  key quantize(const puma_pos &settings) const;
+
+  std::vector<slot> slots;
+  std::size_t mask;
+  std::size_t used{0};
+  float pos_step;
+  float rot_step;
+  ik_cache_stats counters;
+
+  // link lengths the stored solutions were computed for, a different robot
+  // drops the whole table
+  glm::vec3 links{-1.f};
+};
+
+} // namespace pusn
@@ -2,6 +2,7 @@
 
 #include <inputs.hpp>
 #include <interpolator_scene.hpp>
+#include <sim_clock.hpp>
 
 namespace pusn {
 
@@ -18,8 +19,10 @@ struct interpolator {
   interpolator_scene scene;
 
   // functions
-  // init all systems
-  bool init(const std::string &window_title);
+  // init all systems, the simulation runs off clock
+  bool init(const std::string &window_title,
+            sim_clock clock = sim_clock::fixed_step(
+                std::chrono::milliseconds(1)));
   bool main_loop();
   void process_input();
   void render_viewport();
@@ -1,38 +1,51 @@
 #pragma once
 
+#include <array>
 #include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
 #include <vector>
 
 #include <glad/glad.h>
 
 #include <geometry.hpp>
 #include <glfw_impl.hpp>
+#include <kinematic_chain.hpp>
 #include <math.hpp>
 #include <mock_data.hpp>
+#include <sim_clock.hpp>
 
 #include <atomic>
 
 namespace pusn {
 
+struct baked_trajectory;
+struct program_runner;
+
 namespace internal {
 // each of them needs to store:
 //    * geometry
 //    * API object reference
 
-struct puma_state {
-  float base_x{10.f}, base_y{10.f};
-  float l1{15.f};
-  float q2{10.f};
-  float l3{5.f};
-  float l4{5.f};
-
-  float alpha_1{0};
-  float alpha_2{0};
-  float alpha_3{0};
-  float alpha_4{0};
-  float alpha_5{0};
+template <typename T> struct basic_puma_state {
+  T base_x{10}, base_y{10};
+  T l1{15};
+  T q2{10};
+  T l3{5};
+  T l4{5};
+
+  T alpha_1{0};
+  T alpha_2{0};
+  T alpha_3{0};
+  T alpha_4{0};
+  T alpha_5{0};
 };
 
+// the robot as it is animated and drawn, basic_puma_state<double> is only
+// used for offline kinematics
+using puma_state = basic_puma_state<float>;
+
 inline float anorm(float a) { return std::fmod(a + 200 * 360, 360); }
 
 inline float amix(float a, float b, float t) {
@@ -43,7 +56,7 @@ inline float amix(float a, float b, float t) {
   }
 }
 
-inline float adist(float a, float b) {
+template <typename T> inline T adist(T a, T b) {
   if (std::abs(a - b) <= 180) {
     return std::abs(a - b);
   } else {
@@ -51,9 +64,11 @@ inline float adist(float a, float b) {
   }
 }
 
-inline float sq(float a) { return a * a; }
+template <typename T> inline T sq(T a) { return a * a; }
 
-inline float state_dist(const puma_state &a, const puma_state &b) {
+template <typename T>
+inline T state_dist(const basic_puma_state<T> &a,
+                    const basic_puma_state<T> &b) {
   return std::sqrt(
       sq(a.q2 - b.q2) + sq(adist(a.alpha_1, b.alpha_1)) +
       sq(adist(a.alpha_2, b.alpha_2)) + sq(adist(a.alpha_3, b.alpha_3)) +
@@ -86,6 +101,37 @@ struct simulation_settings {
 
   puma_state start_state;
   puma_state end_state;
+
+  // run refine_task on the IK-driven robot after every step
+  bool refine_ik{false};
+};
+
+// one pose of a robot program, reached duration seconds after the
+// previous one
+struct waypoint {
+  math::vec3 position{0.f, 0.f, 0.f};
+  glm::quat rotation{1.f, 0.f, 0.f, 0.f};
+  float duration{1.f};
+};
+
+// IK branch a robot is following between frames, see solve_task_tracked
+struct ik_tracking {
+  static constexpr std::uint8_t no_branch = 0xff;
+
+  std::uint8_t branch{no_branch};
+
+  // the tracked branch is given up for a full solve when its conditioning
+  // drops below min_conditioning or it moves further than max_step from the
+  // previous state (internal::state_dist)
+  float min_conditioning{1e-2f};
+  float max_step{20.f};
+
+  // per-step counters, a tracked step solves a single branch and a full
+  // solve all 8 of them
+  std::size_t tracked_steps{0};
+  std::size_t full_solves{0};
+
+  inline void reset() { branch = no_branch; }
 };
 
 struct light {
@@ -93,6 +139,49 @@ struct light {
   math::vec3 color{1.f, 1.f, 1.f};
 };
 
+// std140 layout of the per_view block of the model and grid shaders,
+// written once per viewport per frame
+struct per_view_block {
+  static constexpr GLuint binding = 0;
+
+  math::mat4 view;
+  math::mat4 proj;
+  // xyz, w unused
+  math::vec4 light_pos;
+  math::vec4 light_color;
+  math::vec4 cam_pos;
+};
+static_assert(sizeof(per_view_block) == 2 * 64 + 3 * 16);
+
+// std430 layout of one robot of the joints buffer of the model shader,
+// which runs kinematics::puma_chain itself
+struct skinning_joints {
+  static constexpr GLuint binding = 2;
+
+  // l1, q2, l3, l4
+  math::vec4 links;
+  // alpha_1 .. alpha_4, degrees
+  math::vec4 angles;
+  // alpha_5, yzw unused
+  math::vec4 wrist;
+
+  inline static skinning_joints from(const puma_state &s) {
+    return {{s.l1, s.q2, s.l3, s.l4},
+            {s.alpha_1, s.alpha_2, s.alpha_3, s.alpha_4},
+            {s.alpha_5, 0.f, 0.f, 0.f}};
+  }
+};
+static_assert(sizeof(skinning_joints) == 3 * 16);
+
+// per draw uniforms of the grid program, resolved once after it is linked
+struct object_uniforms {
+  glfw_impl::uniform<math::mat4> model;
+
+  inline void resolve(GLuint program) {
+    model = glfw_impl::get_uniform<math::mat4>(program, "model");
+  }
+};
+
 struct scene_grid {
   api_agnostic_geometry geometry{{{math::vec3(-1.0, 0.0, -1.0), {}, {}},
                                   {math::vec3(1.0, 0.0, -1.0), {}, {}},
@@ -101,6 +190,7 @@ struct scene_grid {
                                  {0, 1, 2, 2, 3, 0}};
   scene_object_info placement;
   glfw_impl::renderable api_renderable;
+  object_uniforms uniforms;
 };
 
 struct puma_geometry {
@@ -152,25 +242,64 @@ struct puma_geometry {
   }
 };
 
+// parts of the robot, in the order they are merged into puma_renderable
+namespace puma_part {
+constexpr std::size_t base = 0;
+constexpr std::size_t arm_1 = 1;
+constexpr std::size_t joint_12 = 2;
+constexpr std::size_t arm_2 = 3;
+constexpr std::size_t joint_23 = 4;
+constexpr std::size_t arm_3 = 5;
+constexpr std::size_t arm_4 = 6;
+constexpr std::size_t spike_x = 7;
+constexpr std::size_t spike_y = 8;
+constexpr std::size_t spike_z = 9;
+constexpr std::size_t count = 10;
+} // namespace puma_part
+
+// every part of the robot in one merged mesh, a robot is one indirect
+// draw of puma_part::count commands. With gpu_skinning set the vertex
+// shader places each vertex from its part and the joints of the robot,
+// otherwise from the part matrices computed on the CPU
 struct puma_renderable {
-  glfw_impl::renderable base;
-  glfw_impl::renderable arm_1;
-  glfw_impl::renderable joint_12;
-  glfw_impl::renderable arm_2;
-  glfw_impl::renderable joint_23;
-  glfw_impl::renderable arm_3;
-  glfw_impl::renderable arm_4;
-  glfw_impl::renderable spike_x;
-  glfw_impl::renderable spike_y;
-  glfw_impl::renderable spike_z;
+  glfw_impl::merged_mesh mesh;
+  glfw_impl::uniform<bool> gpu_skinning;
 };
 
-struct model {
+// the part of the model the simulation advances, copyable so it can also
+// live on the simulation thread
+struct motion_state {
   std::optional<simulation_settings> current_settings;
-  simulation_settings next_settings;
+  // the current move baked by trajectory_baker, animate plays it back
+  // instead of solving IK wherever it is ready
+  std::shared_ptr<const baked_trajectory> trajectory;
+  // the program the current move is a segment of, animate moves on to its
+  // next segment when the current one ends
+  std::shared_ptr<program_runner> program;
 
   puma_state left_puma{};
   puma_state right_puma{};
+  ik_tracking right_puma_tracking{};
+  // distance of the right puma effector from where it should be, after
+  // refinement when it is enabled
+  float right_puma_residual{0.f};
+};
+
+struct model : motion_state {
+  simulation_settings next_settings;
+  // program being put together in the GUI, run from the start pose of
+  // next_settings
+  std::vector<waypoint> waypoints;
+  // joints at the start pose and every waypoint when they came solved with
+  // a compiled toolpath, and the branch each was solved on. Empty when the
+  // program has to run IK
+  std::vector<puma_state> waypoint_states;
+  std::vector<std::uint8_t> waypoint_branches;
+
+  inline void clear_solved() {
+    waypoint_states.clear();
+    waypoint_branches.clear();
+  }
 
   puma_geometry geometry;
   puma_renderable renderable;
@@ -236,54 +365,53 @@ struct model {
                                      geometry.spike_z.indices, rot_m,
                                      {0.0f, 0.0f, 1.0f});
 
-    glfw_impl::fill_renderable(geometry.base.vertices, geometry.base.indices,
-                               renderable.base);
-    glfw_impl::add_program_to_renderable("resources/model", renderable.base);
-
-    glfw_impl::fill_renderable(geometry.arm_1.vertices, geometry.arm_1.indices,
-                               renderable.arm_1);
-    glfw_impl::add_program_to_renderable("resources/model", renderable.arm_1);
-
-    glfw_impl::fill_renderable(geometry.joint_12.vertices,
-                               geometry.joint_12.indices, renderable.joint_12);
-    glfw_impl::add_program_to_renderable("resources/model",
-                                         renderable.joint_12);
-
-    glfw_impl::fill_renderable(geometry.arm_2.vertices, geometry.arm_2.indices,
-                               renderable.arm_2);
-    glfw_impl::add_program_to_renderable("resources/model", renderable.arm_2);
+    auto &mesh = renderable.mesh;
+    mesh.clear();
+    // the base is a flat quad, seen from below too
+    mesh.add(geometry.base, true);
+    mesh.add(geometry.arm_1);
+    mesh.add(geometry.joint_12);
+    mesh.add(geometry.arm_2);
+    mesh.add(geometry.joint_23);
+    mesh.add(geometry.arm_3);
+    mesh.add(geometry.arm_4);
+    mesh.add(geometry.spike_x);
+    mesh.add(geometry.spike_y);
+    mesh.add(geometry.spike_z);
+    mesh.upload();
+    glfw_impl::add_program_to_renderable("resources/model", mesh.meta);
+    renderable.gpu_skinning = glfw_impl::get_uniform<bool>(
+        mesh.meta.program.value(), "gpu_skinning");
+  }
+};
 
-    glfw_impl::fill_renderable(geometry.joint_23.vertices,
-                               geometry.joint_23.indices, renderable.joint_23);
-    glfw_impl::add_program_to_renderable("resources/model",
-                                         renderable.joint_23);
+} // namespace internal
 
-    glfw_impl::fill_renderable(geometry.arm_3.vertices, geometry.arm_3.indices,
-                               renderable.arm_3);
-    glfw_impl::add_program_to_renderable("resources/model", renderable.arm_3);
+// everything the viewports need from the simulation for one frame, built
+// once by interpolator_scene::update and only read by the renders, so both
+// viewports show the same instant
+struct frame_snapshot {
+  using skinning_t =
+      std::array<glm::mat4, kinematics::puma_chain::size + 1>;
 
-    glfw_impl::fill_renderable(geometry.arm_4.vertices, geometry.arm_4.indices,
-                               renderable.arm_4);
-    glfw_impl::add_program_to_renderable("resources/model", renderable.arm_4);
+  std::uint64_t frame{0};
+  // seconds since the previous update
+  float dt{0.f};
 
-    // spike x
-    glfw_impl::fill_renderable(geometry.spike_x.vertices,
-                               geometry.spike_x.indices, renderable.spike_x);
-    glfw_impl::add_program_to_renderable("resources/model", renderable.spike_x);
+  // the skinning matrices are left empty, the model shader computes them
+  bool gpu_skinning{false};
 
-    // spike x
-    glfw_impl::fill_renderable(geometry.spike_y.vertices,
-                               geometry.spike_y.indices, renderable.spike_y);
-    glfw_impl::add_program_to_renderable("resources/model", renderable.spike_y);
+  // IK driven robot (position interpolation)
+  internal::puma_state ik_puma;
+  skinning_t ik_skinning;
 
-    // spike x
-    glfw_impl::fill_renderable(geometry.spike_z.vertices,
-                               geometry.spike_z.indices, renderable.spike_z);
-    glfw_impl::add_program_to_renderable("resources/model", renderable.spike_z);
-  }
+  // joint space interpolated robot (solution interpolation)
+  internal::puma_state joint_puma;
+  skinning_t joint_skinning;
 };
 
-} // namespace internal
+struct simulation_thread;
+struct trajectory_baker;
 
 struct interpolator_scene {
   internal::simulation_settings settings;
@@ -291,9 +419,58 @@ struct interpolator_scene {
   internal::scene_grid grid;
   internal::light light;
 
+  // where simulated time comes from, and whether the simulation gets its
+  // own thread (one tick per clock step) or steps on the render thread in
+  // update. Both are read by init
+  sim_clock clock{sim_clock::fixed_step(std::chrono::milliseconds(1))};
+  bool threaded_simulation{true};
+  // wall time an as_fast_as_possible clock may spend per frame stepping on
+  // the render thread
+  std::chrono::milliseconds fast_step_budget{8};
+  // the model shader runs the robot's forward kinematics from its joints,
+  // no matrices are computed or uploaded per part
+  bool gpu_skinning{true};
+
+  interpolator_scene();
+  ~interpolator_scene();
+
   bool init();
-  void render(input_state &input, bool left = true);
-  void set_light_uniforms(input_state &input, glfw_impl::renderable &r);
+  // advances the simulation by dt seconds (or picks up the newest state of
+  // the simulation thread), call once per frame before the viewports are
+  // rendered
+  void update(float dt);
+  inline const frame_snapshot &snapshot() const { return current_frame; }
+
+  void render(input_state &input, const frame_snapshot &frame,
+              bool left = true);
+  // fills the per_view block for the camera of one viewport
+  void set_view_uniforms(input_state &input, const math::mat4 &view,
+                         const math::mat4 &proj);
+
+private:
+  // bakes moves started from the GUI, true once the newest one has enough
+  // samples to start playing
+  bool pick_up_move();
+  // hands moves to the simulation thread and copies its state back into
+  // model
+  void sync_simulation();
+  // runs the clock ticks that fit into dt on the render thread
+  void step_simulation(float dt);
+
+  frame_snapshot current_frame;
+  glfw_impl::uniform_buffer<internal::per_view_block> per_view;
+  glfw_impl::storage_buffer<internal::skinning_joints> joints;
+
+  std::unique_ptr<simulation_thread> simulation;
+  std::unique_ptr<trajectory_baker> baker;
+  // start time the GUI gave the move last picked up, and its command id
+  std::chrono::system_clock::time_point submitted_start{};
+  std::uint64_t submitted_command{0};
+  bool submitted_finished{true};
+  // the move is picked up but not playable yet
+  bool waiting_for_bake{false};
+  // frame time not yet covered by fixed clock steps
+  sim_clock::duration pending_time{0};
 };
 
 } // namespace pusn
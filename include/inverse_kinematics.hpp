@@ -1,21 +1,160 @@
 #pragma once
 
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <span>
 #include <vector>
 
+#include <kinematic_chain.hpp>
 #include <math.hpp>
 
 #include <interpolator_scene.hpp>
 
 namespace pusn {
 
-glm::vec3 get_actuator_pos(const internal::puma_state &state);
+// everything below is templated on the scalar, float and double are
+// instantiated - float is what the animation and rendering use, double is
+// for offline planning
 
-struct puma_pos {
-  glm::vec3 pos;
-  glm::quat rot;
+template <typename T> struct basic_puma_pos {
+  glm::vec<3, T> pos;
+  glm::qua<T> rot;
 };
+using puma_pos = basic_puma_pos<float>;
+
+// effector position and orientation, the columns of frame are the tool
+// axes in the same convention solve_task takes puma_pos::rot in, so
+// glm::quat_cast(frame) reproduces it
+template <typename T> struct basic_effector_pose {
+  glm::vec<3, T> pos;
+  glm::mat<3, 3, T> frame;
+};
+using effector_pose = basic_effector_pose<float>;
+
+// forward kinematics of the PUMA chain, generated from
+// kinematics::puma_chain
+template <typename T>
+basic_effector_pose<T>
+forward_kinematics(const internal::basic_puma_state<T> &state);
+
+// columns follow kinematics::puma_chain::variables() - alpha_1, alpha_2,
+// q2, alpha_3, alpha_4, alpha_5 - and are in the same space as
+// forward_kinematics, rotations per degree
+template <typename T>
+using basic_puma_jacobian = kinematics::jacobian<T, kinematics::puma_chain::dof>;
+using puma_jacobian = basic_puma_jacobian<float>;
+
+template <typename T>
+basic_puma_jacobian<T> jacobian(const internal::basic_puma_state<T> &state);
+
+void forward_kinematics_batch(std::span<const internal::puma_state> states,
+                              std::span<effector_pose> out);
+
+// position-only forward kinematics
+template <typename T>
+glm::vec<3, T> get_actuator_pos(const internal::basic_puma_state<T> &state);
+
+// fixed-capacity IK result, all 8 candidate branches live inline and bit b
+// of valid_mask tells whether branch b reaches the requested pose
+template <typename T> struct basic_ik_solutions {
+  static constexpr std::size_t capacity = 8;
+
+  std::array<internal::basic_puma_state<T>, capacity> states;
+  std::uint8_t valid_mask{0};
+
+  inline bool is_valid(std::size_t branch) const {
+    return (valid_mask >> branch) & 1u;
+  }
+  inline bool empty() const { return valid_mask == 0; }
+  inline std::size_t size() const { return std::popcount(valid_mask); }
+
+  // index of the valid branch nearest to the given state in joint space,
+  // capacity if there is none
+  std::size_t closest(const internal::basic_puma_state<T> &to) const;
+};
+using ik_solutions = basic_ik_solutions<float>;
+
+// non-allocating solve for the link lengths of robot, safe to call per frame
+template <typename T>
+basic_ik_solutions<T> solve_task(const internal::basic_puma_state<T> &robot,
+                                 const basic_puma_pos<T> &settings);
 
 std::vector<internal::puma_state> solve_task(internal::model &model,
                                              puma_pos settings);
 
+// incremental solve for consecutive poses of a move - only the branch
+// current is on is solved, all 8 are solved and the nearest to current is
+// taken when there is no tracked branch yet or it turns invalid or
+// near-singular. Updates current and returns true if a solution was found
+bool solve_task_tracked(const internal::puma_state &robot,
+                        const puma_pos &settings,
+                        internal::ik_tracking &tracking,
+                        internal::puma_state &current);
+
+template <typename T> struct basic_ik_refine_settings {
+  // 1-3 iterations are enough from an analytic or previous-frame start
+  int max_iterations{3};
+  // stops early once both residuals are below it
+  T tolerance{T(1e-5)};
+  // Levenberg-Marquardt style damping, relative to the diagonal of J^T J
+  T damping{T(1e-3)};
+};
+using ik_refine_settings = basic_ik_refine_settings<float>;
+
+// what refine_task reached - position distance in scene units, orientation
+// error as the angle in radians
+template <typename T> struct basic_ik_residual {
+  T position{0};
+  T orientation{0};
+  int iterations{0};
+};
+using ik_residual = basic_ik_residual<float>;
+
+// damped Gauss-Newton on the analytic jacobian, warm-started from state
+// (an analytic solution or the previous frame). Only steps that lower the
+// error are taken, so state never gets worse than it came in
+template <typename T>
+basic_ik_residual<T>
+refine_task(internal::basic_puma_state<T> &state,
+            const basic_puma_pos<T> &target,
+            const basic_ik_refine_settings<T> &settings = {});
+
+// structure-of-arrays result of solve_task_batch - every joint variable is
+// stored branch-major (branch * count + pose), so each of the 8 candidate
+// branches of a trajectory is one contiguous stream
+struct ik_batch_solutions {
+  static constexpr std::size_t branch_count = 8;
+
+  std::size_t count{0};
+
+  std::vector<float> q2;
+  std::vector<float> alpha_1;
+  std::vector<float> alpha_2;
+  std::vector<float> alpha_3;
+  std::vector<float> alpha_4;
+  std::vector<float> alpha_5;
+
+  // 1 if the branch reaches the requested pose, 0 if solve_task would
+  // have filtered it out
+  std::vector<std::uint8_t> valid;
+
+  void resize(std::size_t pose_count);
+
+  inline std::size_t index(std::size_t branch, std::size_t pose) const {
+    return branch * count + pose;
+  }
+
+  // gather one branch of one pose back into an AoS state, link lengths
+  // are taken from robot
+  internal::puma_state get(const internal::puma_state &robot,
+                           std::size_t branch, std::size_t pose) const;
+};
+
+// solves all poses at once for the link lengths of robot, branch b of each
+// pose matches the b-th candidate solve_task generates before filtering
+void solve_task_batch(const internal::puma_state &robot,
+                      std::span<const puma_pos> poses,
+                      ik_batch_solutions &out);
+
 } // namespace pusn
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <tuple>
+#include <utility>
+
+#include <math.hpp>
+
+namespace pusn {
+namespace kinematics {
+
+// compile-time description of a serial chain. A chain is a type-level list
+// of joints, each one reads its parameter from the robot state, and FK,
+// per-link skinning matrices and the Jacobian are generated from that list
+// as fully unrolled code - the only dispatch is if constexpr
+
+enum class axis { x, y, z };
+
+// robot state variables a joint can be driven by
+enum class var { l1, q2, l3, l4, alpha_1, alpha_2, alpha_3, alpha_4, alpha_5 };
+
+// reference to the variable, const if the state is
+template <var V, typename State> constexpr auto &value(State &s) {
+  if constexpr (V == var::l1) {
+    return s.l1;
+  } else if constexpr (V == var::q2) {
+    return s.q2;
+  } else if constexpr (V == var::l3) {
+    return s.l3;
+  } else if constexpr (V == var::l4) {
+    return s.l4;
+  } else if constexpr (V == var::alpha_1) {
+    return s.alpha_1;
+  } else if constexpr (V == var::alpha_2) {
+    return s.alpha_2;
+  } else if constexpr (V == var::alpha_3) {
+    return s.alpha_3;
+  } else if constexpr (V == var::alpha_4) {
+    return s.alpha_4;
+  } else {
+    return s.alpha_5;
+  }
+}
+
+// rotation + translation, cheaper to chain than a full mat4
+template <typename T> struct rigid {
+  glm::mat<3, 3, T> r{T(1)};
+  glm::vec<3, T> t{T(0)};
+};
+
+template <typename T> inline glm::mat<4, 4, T> to_mat4(const rigid<T> &f) {
+  glm::mat<4, 4, T> ret{f.r};
+  ret[3] = glm::vec<4, T>(f.t, T(1));
+  return ret;
+}
+
+template <axis A> constexpr int axis_index() { return static_cast<int>(A); }
+
+// fixed offset along an axis, e.g. a link length
+template <axis A, var V, int Sign = 1> struct translate {
+  static constexpr bool actuated = false;
+  static constexpr bool rotation = false;
+  static constexpr axis joint_axis = A;
+  static constexpr var variable = V;
+  static constexpr int sign = Sign;
+
+  template <typename T, typename State>
+  static inline rigid<T> apply(rigid<T> f, const State &s) {
+    f.t += f.r[axis_index<A>()] * (T(Sign) * T(value<V>(s)));
+    return f;
+  }
+};
+
+// actuated translation along an axis
+template <axis A, var V, int Sign = 1> struct prismatic : translate<A, V, Sign> {
+  static constexpr bool actuated = true;
+};
+
+// actuated rotation about an axis, the variable is in degrees
+template <axis A, var V, int Sign = 1> struct rotate {
+  static constexpr bool actuated = true;
+  static constexpr bool rotation = true;
+  static constexpr axis joint_axis = A;
+  static constexpr var variable = V;
+  static constexpr int sign = Sign;
+
+  template <typename T, typename State>
+  static inline rigid<T> apply(rigid<T> f, const State &s) {
+    const auto angle = glm::radians(T(Sign) * T(value<V>(s)));
+    const auto c = std::cos(angle);
+    const auto sn = std::sin(angle);
+    // right-multiplying by an axis rotation only mixes the other two columns
+    constexpr int i = (axis_index<A>() + 1) % 3;
+    constexpr int j = (axis_index<A>() + 2) % 3;
+    const auto ci = f.r[i];
+    const auto cj = f.r[j];
+    f.r[i] = c * ci + sn * cj;
+    f.r[j] = c * cj - sn * ci;
+    return f;
+  }
+};
+
+// linear and angular velocity of the chain end per unit of each actuated
+// variable (per degree for rotations), in chain order
+template <typename T, std::size_t N> struct jacobian {
+  std::array<glm::vec<3, T>, N> linear;
+  std::array<glm::vec<3, T>, N> angular;
+};
+
+template <typename... Joints> struct chain {
+  static constexpr std::size_t size = sizeof...(Joints);
+  static constexpr std::size_t dof = (std::size_t{Joints::actuated} + ...);
+
+  template <std::size_t I>
+  using joint = std::tuple_element_t<I, std::tuple<Joints...>>;
+
+  // position of joint I among the actuated joints
+  template <std::size_t I> static constexpr std::size_t dof_index() {
+    constexpr bool actuated[] = {Joints::actuated...};
+    std::size_t ret = 0;
+    for (std::size_t k = 0; k < I; ++k) {
+      ret += actuated[k];
+    }
+    return ret;
+  }
+
+  // actuated variables in chain order, matches the Jacobian columns
+  static constexpr std::array<var, dof> variables() {
+    std::array<var, dof> ret{};
+    std::size_t k = 0;
+    ((Joints::actuated ? void(ret[k++] = Joints::variable) : void()), ...);
+    return ret;
+  }
+
+  // frame after each joint, frames()[0] is the chain root
+  template <typename T, typename State>
+  static inline std::array<rigid<T>, size + 1> frames(const State &s) {
+    std::array<rigid<T>, size + 1> ret;
+    frames_impl<T>(ret, s, std::make_index_sequence<size>{});
+    return ret;
+  }
+
+  template <typename T, typename State>
+  static inline rigid<T> end_frame(const State &s) {
+    rigid<T> f;
+    ((f = Joints::template apply<T>(f, s)), ...);
+    return f;
+  }
+
+  template <typename T, typename State>
+  static inline std::array<glm::mat<4, 4, T>, size + 1>
+  skinning(const State &s) {
+    const auto f = frames<T>(s);
+    std::array<glm::mat<4, 4, T>, size + 1> ret;
+    for (std::size_t i = 0; i < size + 1; ++i) {
+      ret[i] = to_mat4(f[i]);
+    }
+    return ret;
+  }
+
+  template <typename T, typename State>
+  static inline jacobian<T, dof> jacobian_of(const State &s) {
+    const auto f = frames<T>(s);
+    jacobian<T, dof> ret;
+    jacobian_impl<T>(ret, f, std::make_index_sequence<size>{});
+    return ret;
+  }
+
+private:
+  template <typename T, typename State, std::size_t... I>
+  static inline void frames_impl(std::array<rigid<T>, size + 1> &f,
+                                 const State &s, std::index_sequence<I...>) {
+    ((f[I + 1] = joint<I>::template apply<T>(f[I], s)), ...);
+  }
+
+  template <typename T, std::size_t I>
+  static inline void jacobian_column(jacobian<T, dof> &j,
+                                     const std::array<rigid<T>, size + 1> &f) {
+    using J = joint<I>;
+    if constexpr (J::actuated) {
+      constexpr auto col = dof_index<I>();
+      // the joint axis is the same before and after the joint itself
+      const auto dir = f[I].r[axis_index<J::joint_axis>()];
+      if constexpr (J::rotation) {
+        const auto w = dir * glm::radians(T(J::sign));
+        j.linear[col] = glm::cross(w, f[size].t - f[I].t);
+        j.angular[col] = w;
+      } else {
+        j.linear[col] = dir * T(J::sign);
+        j.angular[col] = glm::vec<3, T>(T(0));
+      }
+    }
+  }
+
+  template <typename T, std::size_t... I>
+  static inline void jacobian_impl(jacobian<T, dof> &j,
+                                   const std::array<rigid<T>, size + 1> &f,
+                                   std::index_sequence<I...>) {
+    (jacobian_column<T, I>(j, f), ...);
+  }
+};
+
+// the PUMA arm in render space (y up), matches how the links are drawn
+using puma_chain = chain<translate<axis::y, var::l1>,      //
+                         rotate<axis::y, var::alpha_1>,     //
+                         rotate<axis::z, var::alpha_2, -1>, //
+                         prismatic<axis::x, var::q2>,       //
+                         rotate<axis::z, var::alpha_3, -1>, //
+                         translate<axis::y, var::l3, -1>,   //
+                         rotate<axis::y, var::alpha_4>,     //
+                         translate<axis::x, var::l4>,       //
+                         rotate<axis::x, var::alpha_5>>;
+
+// indices into puma_chain::frames / skinning of the frame each part of the
+// robot is drawn in
+namespace puma_link {
+constexpr std::size_t base = 0;
+constexpr std::size_t joint_12 = 2;
+constexpr std::size_t arm_2 = 3;
+constexpr std::size_t joint_23 = 4;
+constexpr std::size_t arm_3 = 5;
+constexpr std::size_t arm_4 = 7;
+constexpr std::size_t effector = 9;
+} // namespace puma_link
+
+} // namespace kinematics
+} // namespace pusn
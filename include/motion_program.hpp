@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <ik_cache.hpp>
+#include <interpolator_scene.hpp>
+#include <spsc_ring.hpp>
+
+namespace pusn {
+
+// joint state of the IK branch closest to near that reaches w, written to
+// out. The branches come through cache, so a program returning to a pose
+// solves it once. Returns the branch, ik_tracking::no_branch (and
+// out = near) when w is unreachable
+std::uint8_t solve_waypoint(ik_cache &cache,
+                            const internal::puma_state &robot,
+                            const internal::waypoint &w,
+                            const internal::puma_state &near,
+                            internal::puma_state &out);
+
+// a segment of a program ready to play - endpoint states solved and the
+// whole move baked
+struct prepared_segment {
+  std::size_t index{0};
+  internal::simulation_settings settings;
+  std::shared_ptr<const baked_trajectory> trajectory;
+};
+
+// hands out the waypoints of a program in order, false once it is over.
+// Called from the runner's worker thread only
+using waypoint_source = std::function<bool(internal::waypoint &)>;
+
+// plays a robot program, segment i going from waypoint i to waypoint i + 1.
+// A worker thread pulls waypoints from the source and prepares segments
+// ahead of playback: the endpoint IK continues from the end state of the
+// previous segment (so the robot never switches branches at a waypoint)
+// and the segment is baked from where the previous bake left the IK robot.
+// Playback only pops finished segments off a fixed size ring - with a
+// streaming source (gcode_stream) nothing but the lookahead is held in
+// memory, whatever the length of the program. The chain of closest
+// branches makes every segment depend on the one before, so one worker
+// prepares them in order
+struct program_runner {
+  // segments prepared ahead of the one playing
+  static constexpr std::size_t lookahead = 8;
+
+  // robot gives the link lengths and the state the first segment starts
+  // closest to, defaults everything but the poses and lengths
+  program_runner(waypoint_source source, const internal::puma_state &robot,
+                 const internal::simulation_settings &defaults,
+                 float bake_step = 1e-3f);
+  // a program held in memory. states are the already solved joints (see
+  // compiled_toolpath) and no endpoint IK is run, branches the IK branch
+  // each was solved on (ik_tracking::no_branch counts the waypoint as
+  // unreachable). Both are dropped unless there is one of each per
+  // waypoint
+  program_runner(std::vector<internal::waypoint> waypoints,
+                 const internal::puma_state &robot,
+                 const internal::simulation_settings &defaults,
+                 std::vector<internal::puma_state> states = {},
+                 std::vector<std::uint8_t> branches = {},
+                 float bake_step = 1e-3f);
+  ~program_runner();
+
+  program_runner(const program_runner &) = delete;
+  program_runner &operator=(const program_runner &) = delete;
+
+  void start();
+  void stop();
+
+  // consumer side, the next segment in order, false if it is not prepared
+  // yet or the program is over
+  bool next(prepared_segment &out);
+  // every segment has been handed out
+  inline bool done() const {
+    return exhausted.load(std::memory_order_acquire) && segments.empty();
+  }
+  // consumer side, segments prepared and not handed out yet
+  inline std::size_t in_flight() const { return segments.size(); }
+  // consumer side, playback is waiting for the next segment this tick
+  inline void note_underrun() {
+    underruns.fetch_add(1, std::memory_order_relaxed);
+    if (!waiting) {
+      waiting = true;
+      underrun_events.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  // progress counters, readable from any thread
+  std::atomic<std::size_t> waypoints_read{0};
+  std::atomic<std::size_t> prepared{0};
+  std::atomic<std::size_t> handed_out{0};
+  // waypoints without an IK solution, the robot holds its joints over
+  // their segments
+  std::atomic<std::size_t> unreachable{0};
+  // ticks playback spent waiting for a segment and the number of times it
+  // started waiting
+  std::atomic<std::size_t> underruns{0};
+  std::atomic<std::size_t> underrun_events{0};
+
+private:
+  void run();
+
+  waypoint_source source;
+  // solved joints and their branches by waypoint index, empty when the
+  // worker solves them
+  const std::vector<internal::puma_state> states;
+  const std::vector<std::uint8_t> branches;
+  const internal::puma_state robot;
+  const internal::simulation_settings defaults;
+  const float bake_step;
+  // only used by the worker
+  ik_cache cache;
+
+  spsc_ring<prepared_segment, lookahead> segments;
+  std::thread worker;
+  std::atomic<bool> stop_requested{false};
+  // the worker has pushed the last segment
+  std::atomic<bool> exhausted{false};
+  // owned by the consumer, inside an underrun
+  bool waiting{false};
+};
+
+} // namespace pusn
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <inverse_kinematics.hpp>
+#include <utils.hpp>
+
+namespace pusn {
+
+// precomputed answer to "how many IK branches reach this pose" over a
+// regular grid of effector positions (task space) times a fixed set of
+// tool orientations. Lookups are a few multiplies and one byte load, no IK
+//
+// file layout (little endian), also the in-memory layout, so a loaded
+// volume is the mapped file itself:
+//    reachability_header
+//    orientation_count x float[4] (quaternion x, y, z, w)
+//    nx * ny * nz * orientation_count branch counts, one byte each,
+//    index ((z * ny + y) * nx + x) * orientation_count + orientation
+struct reachability_header {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t orientation_count;
+  std::int32_t resolution[3];
+  float min[3];
+  float max[3];
+  // l1, l3, l4 the volume was computed for
+  float links[3];
+};
+
+// the 24 axis-aligned tool orientations
+std::vector<glm::quat> cube_orientations();
+
+struct reachability_volume {
+  static constexpr char magic[8] = {'P', 'U', 'M', 'A', 'R', 'C', 'H', '\0'};
+  static constexpr std::uint32_t version = 1;
+
+  reachability_volume() = default;
+  ~reachability_volume();
+  reachability_volume(reachability_volume &&other) noexcept;
+  reachability_volume &operator=(reachability_volume &&other) noexcept;
+  reachability_volume(const reachability_volume &) = delete;
+  reachability_volume &operator=(const reachability_volume &) = delete;
+
+  // sweeps every cell center and orientation through solve_task, cells
+  // are spread over all cores
+  static reachability_volume compute(const internal::puma_state &robot,
+                                     const glm::vec3 &min,
+                                     const glm::vec3 &max,
+                                     const glm::ivec3 &resolution,
+                                     std::span<const glm::quat> orientations);
+
+  // maps the file read-only, nullopt if it is missing or not a volume
+  static std::optional<reachability_volume>
+  load(const std::filesystem::path &path);
+
+  bool save(const std::filesystem::path &path) const;
+
+  inline bool empty() const { return bytes == nullptr; }
+  inline const reachability_header &header() const {
+    return *reinterpret_cast<const reachability_header *>(bytes);
+  }
+  inline std::span<const glm::quat> orientations() const { return rotations; }
+
+  // true if the volume was computed for the link lengths of robot
+  bool matches(const internal::puma_state &robot) const;
+
+  // orientation of the set closest to rot
+  std::size_t nearest_orientation(const glm::quat &rot) const;
+
+  // 0 for unreachable poses and positions outside of the grid
+  std::uint8_t branch_count(const glm::vec3 &pos,
+                            std::size_t orientation) const;
+
+  inline bool reachable(const glm::vec3 &pos, const glm::quat &rot) const {
+    return !empty() && branch_count(pos, nearest_orientation(rot)) > 0;
+  }
+
+private:
+  static std::size_t data_offset(std::size_t orientation_count);
+  void release();
+  void read_orientations();
+
+  // computed volumes own the image here
+  std::vector<std::uint8_t> storage;
+  // loaded volumes
+  utils::mapped_file file;
+
+  const std::uint8_t *bytes{nullptr};
+  const std::uint8_t *counts{nullptr};
+  std::vector<glm::quat> rotations;
+};
+
+} // namespace pusn
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <chrono>
+
+namespace pusn {
+
+// where simulated time comes from. Everything that advances the simulation
+// asks the clock instead of reading system_clock itself, so the same move
+// can be played live, reproduced tick by tick or run through in a batch
+//    real_time           - now() follows the wall clock, not reproducible
+//    fixed_step          - every tick adds step, the simulation thread
+//                          paces ticks to the wall clock, the render thread
+//                          takes as many steps as fit into the frame
+//    as_fast_as_possible - every tick adds step and nothing waits while a
+//                          move runs, for validation and batch runs. The
+//                          render thread takes ticks until the move ends
+//                          or its frame budget is spent, the simulation
+//                          thread parks until the next command
+struct sim_clock {
+  using duration = std::chrono::system_clock::duration;
+  using time_point = std::chrono::system_clock::time_point;
+
+  enum class mode { real_time, fixed_step, as_fast_as_possible };
+
+  static inline sim_clock
+  real_time(duration tick = std::chrono::milliseconds(1)) {
+    return sim_clock{mode::real_time, tick, std::chrono::system_clock::now()};
+  }
+  static inline sim_clock
+  fixed_step(duration step = std::chrono::milliseconds(1),
+             time_point start = {}) {
+    return sim_clock{mode::fixed_step, step, start};
+  }
+  static inline sim_clock
+  as_fast_as_possible(duration step = std::chrono::milliseconds(1),
+                      time_point start = {}) {
+    return sim_clock{mode::as_fast_as_possible, step, start};
+  }
+
+  inline time_point now() const { return current; }
+
+  // moves to the next tick and returns it
+  inline time_point advance() {
+    current = kind == mode::real_time ? std::chrono::system_clock::now()
+                                      : current + step;
+    return current;
+  }
+
+  // whether a thread driving this clock should wait for the wall clock
+  // between ticks
+  inline bool paced() const { return kind != mode::as_fast_as_possible; }
+
+  mode kind;
+  // tick length, also the tick period of a paced simulation thread
+  duration step;
+  time_point current;
+};
+
+} // namespace pusn
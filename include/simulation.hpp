@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+#include <interpolator_scene.hpp>
+#include <sim_clock.hpp>
+#include <triple_buffer.hpp>
+
+namespace pusn {
+
+// advances the running move (if any) to the given time - the left puma is
+// interpolated in joint space, the right puma follows the effector path
+// through IK, staying on the branch closest to its previous state. Where
+// model.trajectory is baked the states are looked up instead, at the end
+// of a segment of model.program the next one takes over.
+// Does not allocate, so it is safe to run every frame
+void animate(internal::motion_state &model,
+             std::chrono::system_clock::time_point time);
+
+// solves the running move at progress in [0, 1] of its length, what
+// animate does for parts of a move that are not baked
+void solve_motion(internal::motion_state &model, float progress);
+
+// plays the move in motion from clock.now() to its end, one animate per
+// clock tick and without ever waiting, returns the number of ticks. With a
+// fixed_step or as_fast_as_possible clock the result is bit-identical
+// between runs
+std::uint64_t run_motion(internal::motion_state &motion, sim_clock &clock,
+                         std::uint64_t max_ticks = 100'000'000);
+
+// a move handed to the simulation thread, only the newest one counts
+struct motion_command {
+  std::uint64_t id{0};
+  std::optional<internal::simulation_settings> settings;
+  std::shared_ptr<const baked_trajectory> trajectory;
+  std::shared_ptr<program_runner> program;
+  internal::puma_state left_puma;
+  internal::puma_state right_puma;
+};
+
+// what the simulation thread publishes after every tick
+struct motion_snapshot {
+  std::uint64_t tick{0};
+  // the last command the simulation has applied, 0 before the first one
+  std::uint64_t command_id{0};
+  bool running{false};
+  internal::puma_state left_puma;
+  internal::puma_state right_puma;
+  float right_puma_residual{0.f};
+};
+
+// runs animate on its own thread, one tick per clock.step. With a
+// fixed_step clock simulated time advances by exactly one step per tick,
+// whatever the render thread is doing, an as_fast_as_possible clock does
+// not wait between ticks and parks the thread while no move runs. Both
+// directions go through triple buffers so neither side blocks
+struct simulation_thread {
+  explicit simulation_thread(
+      sim_clock clock = sim_clock::fixed_step(std::chrono::milliseconds(1)));
+  ~simulation_thread();
+
+  simulation_thread(const simulation_thread &) = delete;
+  simulation_thread &operator=(const simulation_thread &) = delete;
+
+  void start();
+  void stop();
+
+  // ticks per second
+  inline float rate() const {
+    return 1.f / std::chrono::duration<float>(clock.step).count();
+  }
+
+  // render thread - starts motion.current_settings (or stops the robot if
+  // it is empty) from the given robot states, returns the command id
+  std::uint64_t submit(const internal::motion_state &motion);
+
+  // render thread - picks up the newest snapshot, true if there was one
+  inline bool poll() { return snapshots.update(); }
+  inline const motion_snapshot &latest() const { return snapshots.front(); }
+
+private:
+  void run();
+
+  sim_clock clock;
+  std::thread worker;
+  std::atomic<bool> stop_requested{false};
+  // wakes a parked simulation thread on submit and stop
+  std::mutex wake_mutex;
+  std::condition_variable wake;
+  bool woken{false};
+
+  triple_buffer<motion_command> commands;
+  triple_buffer<motion_snapshot> snapshots;
+  std::uint64_t next_command_id{1};
+
+  // owned by the simulation thread
+  internal::motion_state motion;
+};
+
+} // namespace pusn
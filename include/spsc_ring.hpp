@@ -0,0 +1,54 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace pusn {
+
+// bounded single producer / single consumer queue, push and pop never
+// block and never allocate. Capacity has to be a power of two
+template <typename T, std::size_t Capacity> struct spsc_ring {
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                "spsc_ring capacity has to be a power of two");
+
+  // producer side, false if the ring is full
+  inline bool push(T value) {
+    const auto h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == Capacity) {
+      return false;
+    }
+    slots[h & mask] = std::move(value);
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer side, false if the ring is empty
+  inline bool pop(T &out) {
+    const auto t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) {
+      return false;
+    }
+    out = std::move(slots[t & mask]);
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // either side, only a snapshot while the other one is running
+  inline std::size_t size() const {
+    return head.load(std::memory_order_acquire) -
+           tail.load(std::memory_order_acquire);
+  }
+  inline bool empty() const { return size() == 0; }
+  static constexpr std::size_t capacity() { return Capacity; }
+
+private:
+  static constexpr std::size_t mask = Capacity - 1;
+
+  std::array<T, Capacity> slots{};
+  // total pushes and pops, each written by one side only
+  alignas(64) std::atomic<std::size_t> head{0};
+  alignas(64) std::atomic<std::size_t> tail{0};
+};
+
+} // namespace pusn
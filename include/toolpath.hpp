@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <interpolator_scene.hpp>
+#include <utils.hpp>
+
+namespace pusn {
+
+// a robot program compiled ahead of time: waypoints plus the IK branch and
+// joints solved for each of them, so loading it needs neither a G-code
+// parse nor IK (as long as the robot has the same link lengths)
+//
+// file layout (little endian), also the in-memory layout, so a loaded
+// toolpath is the mapped file itself:
+//    toolpath_header
+//    toolpath_columns arrays of waypoint_count floats, in the order of
+//    toolpath_column
+//    waypoint_count IK branches, one byte each (0xff unreachable)
+struct toolpath_header {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t waypoint_count;
+  // l1, l3, l4 the joints were solved for
+  float links[3];
+  std::uint32_t reserved;
+  // FNV-1a of everything after the header
+  std::uint64_t checksum;
+};
+
+enum class toolpath_column : std::uint32_t {
+  position_x,
+  position_y,
+  position_z,
+  rotation_x,
+  rotation_y,
+  rotation_z,
+  rotation_w,
+  duration,
+  q2,
+  alpha_1,
+  alpha_2,
+  alpha_3,
+  alpha_4,
+  alpha_5
+};
+inline constexpr std::size_t toolpath_columns = 14;
+
+struct compiled_toolpath {
+  static constexpr char magic[8] = {'P', 'U', 'M', 'A', 'P', 'A', 'T', 'H'};
+  static constexpr std::uint32_t version = 1;
+
+  compiled_toolpath() = default;
+  ~compiled_toolpath();
+  compiled_toolpath(compiled_toolpath &&other) noexcept;
+  compiled_toolpath &operator=(compiled_toolpath &&other) noexcept;
+  compiled_toolpath(const compiled_toolpath &) = delete;
+  compiled_toolpath &operator=(const compiled_toolpath &) = delete;
+
+  // solves every waypoint for robot the way program_runner does, each on
+  // the branch closest to the previous one
+  static compiled_toolpath compile(const internal::puma_state &robot,
+                                   std::span<const internal::waypoint> path);
+
+  // maps the file read-only, nullopt if it is missing, not a toolpath or
+  // fails its checksum
+  static std::optional<compiled_toolpath>
+  load(const std::filesystem::path &path);
+
+  bool save(const std::filesystem::path &path) const;
+
+  inline bool empty() const { return bytes == nullptr; }
+  inline const toolpath_header &header() const {
+    return *reinterpret_cast<const toolpath_header *>(bytes);
+  }
+  inline std::size_t size() const {
+    return empty() ? 0 : header().waypoint_count;
+  }
+
+  // true if the joints were solved for the link lengths of robot
+  bool matches(const internal::puma_state &robot) const;
+
+  inline std::span<const float> column(toolpath_column c) const {
+    return {reinterpret_cast<const float *>(bytes + sizeof(toolpath_header)) +
+                static_cast<std::size_t>(c) * size(),
+            size()};
+  }
+  inline std::span<const std::uint8_t> branches() const {
+    return {bytes + sizeof(toolpath_header) +
+                toolpath_columns * size() * sizeof(float),
+            size()};
+  }
+
+  // waypoints back in array of structs form, for program_runner
+  std::vector<internal::waypoint> waypoints() const;
+  // joints at every waypoint, on robot's base and links
+  std::vector<internal::puma_state>
+  states(const internal::puma_state &robot) const;
+  std::size_t unreachable() const;
+
+private:
+  static std::size_t image_size(std::size_t waypoint_count);
+  static std::uint64_t checksum(std::span<const std::uint8_t> payload);
+  void release();
+
+  // compiled toolpaths own the image here
+  std::vector<std::uint8_t> storage;
+  // loaded toolpaths
+  utils::mapped_file file;
+
+  const std::uint8_t *bytes{nullptr};
+};
+
+} // namespace pusn
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <interpolator_scene.hpp>
+
+namespace pusn {
+
+// both robots at one instant of a baked move
+struct trajectory_sample {
+  internal::puma_state left_puma;
+  internal::puma_state right_puma;
+  float right_puma_residual{0.f};
+};
+
+// a whole move sampled every step seconds, sample i is the state at
+// i * step (the last one at the end of the move). The array is sized up
+// front and filled front to back by trajectory_baker, samples below
+// ready() are final and can be read from any thread
+struct baked_trajectory {
+  baked_trajectory(float length, float step);
+
+  // samples published in one go, playback can start once the first chunk
+  // is in
+  static constexpr std::size_t chunk = 256;
+
+  inline std::size_t size() const { return samples.size(); }
+  inline std::size_t ready() const {
+    return baked.load(std::memory_order_acquire);
+  }
+  inline bool complete() const { return ready() == size(); }
+  inline bool playable() const { return ready() >= std::min(chunk, size()); }
+  inline float progress() const {
+    return static_cast<float>(ready()) / static_cast<float>(size());
+  }
+
+  // writes the state t seconds into the move to out, lerping the two
+  // neighbouring samples. Returns false (leaving out as is) when they are
+  // not baked yet
+  bool sample(float t, internal::motion_state &out) const;
+
+  float length;
+  float step;
+  std::vector<trajectory_sample> samples;
+
+  // set by the baker as chunks are done, set to stop a bake early
+  std::atomic<std::size_t> baked{0};
+  std::atomic<bool> cancelled{false};
+};
+
+// fills trajectory on the calling thread, right_puma is where IK tracking
+// starts from. Stops early when the trajectory is cancelled or stop (the
+// flag of whoever owns the baking thread) is set
+void bake_trajectory(baked_trajectory &trajectory,
+                     const internal::simulation_settings &settings,
+                     const internal::puma_state &left_puma,
+                     const internal::puma_state &right_puma,
+                     const std::atomic<bool> *stop = nullptr);
+
+// bakes moves on a worker thread, one at a time - starting a new bake
+// cancels the previous one
+struct trajectory_baker {
+  trajectory_baker() = default;
+  ~trajectory_baker();
+
+  trajectory_baker(const trajectory_baker &) = delete;
+  trajectory_baker &operator=(const trajectory_baker &) = delete;
+
+  // starts baking settings from the given robot states, the returned
+  // trajectory fills in while the caller goes on
+  std::shared_ptr<const baked_trajectory>
+  bake(const internal::simulation_settings &settings,
+       const internal::puma_state &left_puma,
+       const internal::puma_state &right_puma, float step = 1e-3f);
+
+  // stops the running bake (if any) and waits for the worker
+  void cancel();
+
+private:
+  std::shared_ptr<baked_trajectory> current;
+  std::thread worker;
+};
+
+} // namespace pusn
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace pusn {
+
+// single producer / single consumer handoff of the latest value. The
+// producer fills back() and publishes it, the consumer picks up whatever
+// was published last - neither side ever waits for the other, values the
+// consumer did not get to in time are simply overwritten
+template <typename T> struct triple_buffer {
+  // producer side
+  inline T &back() { return slots[back_index].value; }
+
+  inline void publish() {
+    const auto prev =
+        middle.exchange(back_index | dirty, std::memory_order_acq_rel);
+    back_index = prev & index_mask;
+  }
+
+  // consumer side, true if a newer value than the previous front() was
+  // taken
+  inline bool update() {
+    if (!(middle.load(std::memory_order_relaxed) & dirty)) {
+      return false;
+    }
+    const auto prev = middle.exchange(front_index, std::memory_order_acq_rel);
+    front_index = prev & index_mask;
+    return true;
+  }
+
+  inline const T &front() const { return slots[front_index].value; }
+
+private:
+  static constexpr std::uint8_t index_mask = 3;
+  static constexpr std::uint8_t dirty = 4;
+
+  // each slot on its own cache line, the two threads work on different ones
+  struct alignas(64) slot {
+    T value{};
+  };
+
+  std::array<slot, 3> slots;
+  // index of the slot in the middle plus the dirty flag
+  alignas(64) std::atomic<std::uint8_t> middle{1};
+  // owned by the producer
+  alignas(64) std::uint8_t back_index{0};
+  // owned by the consumer
+  alignas(64) std::uint8_t front_index{2};
+};
+
+} // namespace pusn
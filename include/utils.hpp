@@ -1,15 +1,112 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <span>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include <logger.hpp>
 
 namespace pusn {
 namespace utils {
 
+// a whole file mapped read-only for the lifetime of the object (read in on
+// platforms without mmap), nothing is copied out of it
+struct mapped_file {
+  // the lines of a text, each without its '\n', as views into it. Like
+  // std::getline there is no empty line after a final '\n'
+  struct line_view {
+    struct iterator {
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = std::string_view;
+      using difference_type = std::ptrdiff_t;
+      using pointer = const std::string_view *;
+      using reference = const std::string_view &;
+
+      iterator() = default;
+      inline iterator(const char *it, const char *end) : it(it), end(end) {
+        find_line();
+      }
+
+      inline reference operator*() const { return line; }
+      inline pointer operator->() const { return &line; }
+      inline iterator &operator++() {
+        it = next;
+        find_line();
+        return *this;
+      }
+      inline iterator operator++(int) {
+        auto ret = *this;
+        ++*this;
+        return ret;
+      }
+      inline bool operator==(const iterator &other) const {
+        return it == other.it;
+      }
+
+    private:
+      void find_line();
+
+      const char *it{nullptr};
+      const char *end{nullptr};
+      const char *next{nullptr};
+      std::string_view line;
+    };
+
+    inline iterator begin() const {
+      return {text.data(), text.data() + text.size()};
+    }
+    inline iterator end() const {
+      return {text.data() + text.size(), text.data() + text.size()};
+    }
+
+    std::string_view text;
+  };
+
+  mapped_file() = default;
+  // check is_open() for failures
+  explicit mapped_file(const std::filesystem::path &path);
+  ~mapped_file();
+  mapped_file(mapped_file &&other) noexcept;
+  mapped_file &operator=(mapped_file &&other) noexcept;
+  mapped_file(const mapped_file &) = delete;
+  mapped_file &operator=(const mapped_file &) = delete;
+
+  // empty files are open but have no data
+  inline bool is_open() const { return opened; }
+  inline std::size_t size() const { return length; }
+  inline const char *data() const { return begin; }
+
+  inline std::string_view text() const { return {begin, length}; }
+  inline std::span<const std::uint8_t> bytes() const {
+    return {reinterpret_cast<const std::uint8_t *>(begin), length};
+  }
+  inline line_view lines() const { return {text()}; }
+
+  // the file is going to be read front to back once
+  void advise_sequential() const;
+  // gives back the memory of the whole pages before offset, reading them
+  // again reads the file again
+  void discard(std::size_t offset) const;
+
+private:
+  void release();
+
+  // platforms without mmap
+  std::vector<char> storage;
+  void *mapping{nullptr};
+
+  const char *begin{nullptr};
+  std::size_t length{0};
+  bool opened{false};
+};
+
 std::string read_text_file(std::filesystem::path shader_file);
 
 std::vector<std::string>
@@ -5,8 +5,15 @@ layout(location = 1) in vec3 norm;
 layout(location = 2) in vec3 color;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 proj;
+
+// per view data, internal::per_view_block on the CPU side
+layout(std140, binding = 0) uniform per_view {
+    mat4 view;
+    mat4 proj;
+    vec4 light_pos;
+    vec4 light_color;
+    vec4 cam_pos;
+};
 
 float gridSize = 10000.0f;
 float gridCellSize = 0.05f;
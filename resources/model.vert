@@ -3,16 +3,124 @@
 layout(location = 0) in vec3 pos;
 layout(location = 1) in vec3 norm;
 layout(location = 2) in vec3 col;
+// internal::puma_part of the vertex (glfw_impl::merged_mesh::part_attribute)
+layout(location = 3) in uint part;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 proj;
+// model matrix of every draw, gl_DrawID picks the one of the part
+// (glfw_impl::merged_mesh::matrices_binding)
+layout(std430, binding = 1) readonly buffer part_matrices {
+    mat4 models[];
+};
+
+// joints of every robot drawn, gl_InstanceID picks the robot
+// (internal::skinning_joints)
+struct skinning_joints {
+    vec4 links;  // l1, q2, l3, l4
+    vec4 angles; // alpha_1 .. alpha_4, degrees
+    vec4 wrist;  // alpha_5
+};
+layout(std430, binding = 2) readonly buffer robot_joints {
+    skinning_joints robots[];
+};
+
+// placed from the joints rather than from part_matrices
+uniform bool gpu_skinning;
+
+// per view data, internal::per_view_block on the CPU side
+layout(std140, binding = 0) uniform per_view {
+    mat4 view;
+    mat4 proj;
+    vec4 light_pos;
+    vec4 light_color;
+    vec4 cam_pos;
+};
+
+// internal::puma_part
+const uint part_base = 0u;
+const uint part_arm_1 = 1u;
+const uint part_joint_12 = 2u;
+const uint part_arm_2 = 3u;
+const uint part_joint_23 = 4u;
+const uint part_arm_3 = 5u;
+const uint part_arm_4 = 6u;
+
+// frame of kinematics::puma_chain, rotation + translation
+mat3 r;
+vec3 t;
+
+void translate_along(int a, float d) {
+    t += r[a] * d;
+}
+
+// right-multiplying by an axis rotation only mixes the other two columns
+void rotate_about(int a, float degrees) {
+    float c = cos(radians(degrees));
+    float s = sin(radians(degrees));
+    int i = (a + 1) % 3;
+    int j = (a + 2) % 3;
+    vec3 ci = r[i];
+    vec3 cj = r[j];
+    r[i] = c * ci + s * cj;
+    r[j] = c * cj - s * ci;
+}
+
+mat4 frame_matrix() {
+    return mat4(vec4(r[0], 0.0), vec4(r[1], 0.0), vec4(r[2], 0.0),
+                vec4(t, 1.0));
+}
+
+// the same matrix interpolator_scene::render computes for the part, the
+// chain is walked only as far as the part's frame
+mat4 part_matrix(skinning_joints j) {
+    if (part == part_base) {
+        return mat4(vec4(5.0, 0.0, 0.0, 0.0), vec4(0.0, 1.0, 0.0, 0.0),
+                    vec4(0.0, 0.0, 5.0, 0.0), vec4(0.0, 0.0, 0.0, 1.0));
+    }
+    // joints are placed one unit along z of their frame
+    const vec3 joint_offset = vec3(0.0, 0.0, 1.0);
+    r = mat3(1.0);
+    t = vec3(0.0);
+    if (part == part_arm_1) {
+        return frame_matrix();
+    }
+    translate_along(1, j.links.x);
+    rotate_about(1, j.angles.x);
+    if (part == part_joint_12) {
+        t += r * joint_offset;
+        return frame_matrix();
+    }
+    rotate_about(2, -j.angles.y);
+    if (part == part_arm_2) {
+        r[0] *= j.links.y / 10.0;
+        return frame_matrix();
+    }
+    translate_along(0, j.links.y);
+    if (part == part_joint_23) {
+        t += r * joint_offset;
+        return frame_matrix();
+    }
+    rotate_about(2, -j.angles.z);
+    if (part == part_arm_3) {
+        return frame_matrix();
+    }
+    translate_along(1, -j.links.z);
+    rotate_about(1, j.angles.w);
+    if (part == part_arm_4) {
+        return frame_matrix();
+    }
+    // spikes
+    translate_along(0, j.links.w);
+    rotate_about(0, j.wrist.x);
+    return frame_matrix();
+}
 
 out vec3 frag_pos;
 out vec3 normal;
 out vec3 color;
 
 void main() {
+    mat4 model = gpu_skinning ? part_matrix(robots[gl_InstanceID])
+                              : models[gl_DrawID];
     gl_Position = proj * view * model * vec4(pos, 1.0);
     frag_pos = vec3(model * vec4(pos, 1.0));
     normal = transpose(inverse(mat3(model))) * norm;
@@ -0,0 +1,212 @@
+#include <gcode.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+namespace pusn {
+
+namespace {
+
+// reads the number right after a word letter, from_chars wants no '+'
+template <typename T>
+bool read_number(const char *&it, const char *end, T &value) {
+  if (it != end && *it == '+') {
+    ++it;
+  }
+  const auto [ptr, ec] = std::from_chars(it, end, value);
+  if (ec != std::errc{}) {
+    return false;
+  }
+  it = ptr;
+  return true;
+}
+
+inline bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+} // namespace
+
+gcode_reader::gcode_reader(std::string_view text,
+                           const gcode_settings &settings)
+    : text(text), settings(settings), it(text.data()),
+      feed_rate(settings.feed_rate) {
+  counters.bytes = text.size();
+}
+
+bool gcode_reader::fail(std::string_view what) {
+  message = "line " + std::to_string(counters.lines) + ": " +
+            std::string(what);
+  it = text.data() + text.size();
+  return false;
+}
+
+bool gcode_reader::next(internal::waypoint &out) {
+  const auto to_scene = [&](const math::vec3 &p) {
+    return settings.offset + settings.scale * math::vec3{p.x, p.z, -p.y};
+  };
+
+  const char *const end = text.data() + text.size();
+  while (it != end) {
+    const char *eol =
+        static_cast<const char *>(std::memchr(it, '\n', end - it));
+    if (!eol) {
+      eol = end;
+    }
+    ++counters.lines;
+
+    auto target = position;
+    bool moved = false;
+    while (it != eol) {
+      const char letter = *it++;
+      if (is_blank(letter)) {
+        continue;
+      }
+      if (letter == ';' || letter == '%') {
+        it = eol;
+        break;
+      }
+
+      bool ok = true;
+      switch (letter) {
+      case 'N':
+      case 'n': {
+        long number = 0;
+        ok = read_number(it, eol, number);
+        break;
+      }
+      case 'G':
+      case 'g': {
+        int code = 0;
+        ok = read_number(it, eol, code);
+        if (ok && code != 0 && code != 1) {
+          return fail("only G00 and G01 moves are supported");
+        }
+        motion = code;
+        break;
+      }
+      case 'F':
+      case 'f':
+        ok = read_number(it, eol, feed_rate) && feed_rate > 0.f;
+        break;
+      case 'X':
+      case 'x':
+        ok = read_number(it, eol, target.x);
+        moved = true;
+        break;
+      case 'Y':
+      case 'y':
+        ok = read_number(it, eol, target.y);
+        moved = true;
+        break;
+      case 'Z':
+      case 'z':
+        ok = read_number(it, eol, target.z);
+        moved = true;
+        break;
+      default:
+        return fail(std::string("unexpected '") + letter + "'");
+      }
+      if (!ok) {
+        return fail(std::string("bad number after '") + letter + "'");
+      }
+    }
+    it = eol == end ? end : eol + 1;
+
+    if (!moved) {
+      continue;
+    }
+    if (motion < 0) {
+      return fail("move before any G00 / G01");
+    }
+
+    // the first point is where the program starts, every other one is a
+    // move from the previous
+    if (!has_position) {
+      has_position = true;
+      position = target;
+      out = {to_scene(target), settings.tool_rotation, 0.f};
+      return true;
+    }
+    const float distance = glm::length(target - position);
+    if (distance <= 0.f) {
+      ++counters.skipped_moves;
+      continue;
+    }
+    const float rate = motion == 0 ? settings.rapid_rate : feed_rate;
+    position = target;
+    out = {to_scene(target), settings.tool_rotation, distance / rate};
+    return true;
+  }
+  return false;
+}
+
+bool parse_gcode(std::string_view text, const gcode_settings &settings,
+                 std::vector<internal::waypoint> &out, std::string &error,
+                 gcode_stats *stats) {
+  // moves are ~25 bytes a line
+  out.reserve(out.size() + text.size() / 24 + 1);
+
+  gcode_reader reader(text, settings);
+  internal::waypoint w;
+  while (reader.next(w)) {
+    out.push_back(w);
+  }
+  if (stats) {
+    *stats = reader.stats();
+  }
+  if (reader.failed()) {
+    error = reader.error();
+    return false;
+  }
+  return true;
+}
+
+bool load_gcode(const std::filesystem::path &path,
+                const gcode_settings &settings,
+                std::vector<internal::waypoint> &out, std::string &error,
+                gcode_stats *stats) {
+  const utils::mapped_file file(path);
+  if (!file.is_open()) {
+    error = "cannot open " + path.string();
+    return false;
+  }
+  file.advise_sequential();
+  return parse_gcode(file.text(), settings, out, error, stats);
+}
+
+gcode_stream::gcode_stream(const std::filesystem::path &path,
+                           const gcode_settings &settings)
+    : file(path) {
+  if (!file.is_open()) {
+    message = "cannot open " + path.string();
+    done.store(true, std::memory_order_release);
+    return;
+  }
+  size = file.size();
+  file.advise_sequential();
+  reader.emplace(file.text(), settings);
+}
+
+bool gcode_stream::operator()(internal::waypoint &out) {
+  if (!reader || finished()) {
+    return false;
+  }
+  const bool ok = reader->next(out);
+  const auto consumed = reader->consumed();
+  bytes_read.store(consumed, std::memory_order_relaxed);
+
+  // give back what was parsed, the mapping itself stays
+  if (consumed - released >= release_chunk) {
+    file.discard(consumed);
+    released = consumed;
+    bytes_released.store(consumed, std::memory_order_relaxed);
+  }
+
+  if (!ok) {
+    message = reader->error();
+    done.store(true, std::memory_order_release);
+  }
+  return ok;
+}
+
+} // namespace pusn
@@ -1,8 +1,13 @@
 #include <glfw_impl.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <vector>
 
 #include <math.hpp>
 
@@ -22,6 +27,14 @@ math::vec2 glfw_impl::last_frame_info::left_viewport_pos = {};
 math::vec2 glfw_impl::last_frame_info::right_viewport_area = {};
 math::vec2 glfw_impl::last_frame_info::right_viewport_pos = {};
 
+glfw_impl::render_stats glfw_impl::last_frame_info::render = {};
+
+std::unordered_map<std::string, glfw_impl::program_registry::entry>
+    glfw_impl::program_registry::programs;
+std::optional<GLuint> glfw_impl::program_registry::bound;
+glfw_impl::program_registry::stats glfw_impl::program_registry::current;
+glfw_impl::program_registry::stats glfw_impl::program_registry::previous;
+
 void glfw_impl::fill_renderable(std::vector<pos_norm_col> &vertices,
                                 std::vector<unsigned int> &indices,
                                 renderable &out) {
@@ -295,6 +308,9 @@ void glfw_impl::before_frame() {
   clear_color_and_depth(clear_color, clear_depth);
 
   glfw_impl::last_frame_info::begin_time = glfwGetTimerValue();
+  glfw_impl::last_frame_info::render = frame_render_stats;
+  frame_render_stats = {};
+  program_registry::new_frame();
 }
 
 void glfw_impl::after_frame(window_t &w) {
@@ -307,10 +323,11 @@ void glfw_impl::after_frame(window_t &w) {
   poll_events(w);
 }
 
-GLuint compile_shader_from_source(const std::string &source, GLuint type) {
+GLuint compile_shader_from_source(std::string_view source, GLuint type) {
   GLuint shader = glCreateShader(type);
-  const char *src = source.c_str();
-  glShaderSource(shader, 1, &src, NULL);
+  const char *src = source.data();
+  const GLint length = static_cast<GLint>(source.size());
+  glShaderSource(shader, 1, &src, &length);
   glCompileShader(shader);
 
   GLint compiled;
@@ -325,38 +342,165 @@ GLuint compile_shader_from_source(const std::string &source, GLuint type) {
   return shader;
 }
 
-void glfw_impl::add_program_to_renderable(const std::string &program_name,
-                                          renderable &out) {
+namespace {
+
+std::uint64_t fnv1a(std::uint64_t hash, std::string_view bytes) {
+  for (const auto c : bytes) {
+    hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+float ms_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<float, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+} // namespace
+
+std::uint64_t
+glfw_impl::program_cache::key(std::span<const std::string_view> sources) {
+  static const auto driver = []() {
+    std::uint64_t hash = 0xcbf29ce484222325ull;
+    for (const auto name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+      const auto *str = reinterpret_cast<const char *>(glGetString(name));
+      hash = fnv1a(hash, str ? str : "");
+      hash = fnv1a(hash, {"\0", 1});
+    }
+    return hash;
+  }();
+
+  auto hash = driver;
+  for (const auto source : sources) {
+    // the length keeps the boundaries between stages apart
+    const auto size = static_cast<std::uint64_t>(source.size());
+    hash = fnv1a(hash, {reinterpret_cast<const char *>(&size), sizeof(size)});
+    hash = fnv1a(hash, source);
+  }
+  return hash;
+}
+
+std::filesystem::path glfw_impl::program_cache::entry(std::uint64_t key) {
+  char name[24];
+  std::snprintf(name, sizeof(name), "%016llx.bin",
+                static_cast<unsigned long long>(key));
+  return directory / name;
+}
+
+std::optional<GLuint> glfw_impl::program_cache::load(std::uint64_t key) {
+  const auto start = std::chrono::steady_clock::now();
+  const utils::mapped_file file(entry(key));
+  program_binary_header h;
+  if (!file.is_open() || file.size() < sizeof(h)) {
+    return std::nullopt;
+  }
+  std::memcpy(&h, file.data(), sizeof(h));
+  if (std::memcmp(h.magic, magic, sizeof(magic)) != 0 ||
+      h.size != file.size() - sizeof(h)) {
+    LOGGER_WARN("[PROGRAM CACHE] Ignoring malformed {0}",
+                entry(key).string());
+    return std::nullopt;
+  }
+
+  GLuint program = glCreateProgram();
+  glProgramBinary(program, h.format, file.data() + sizeof(h),
+                  static_cast<GLsizei>(h.size));
+  GLint linked;
+  glGetProgramiv(program, GL_LINK_STATUS, &linked);
+  if (linked != GL_TRUE) {
+    // usually a driver update with the same version string
+    LOGGER_WARN("[PROGRAM CACHE] Driver rejected {0}", entry(key).string());
+    glDeleteProgram(program);
+    return std::nullopt;
+  }
+  saved += std::max(h.link_ms - ms_since(start), 0.f);
+  return program;
+}
+
+void glfw_impl::program_cache::store(std::uint64_t key, GLuint program,
+                                     float link_ms) {
+  GLint size = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+  if (size <= 0) {
+    return;
+  }
+  program_binary_header h{};
+  std::memcpy(h.magic, magic, sizeof(magic));
+  h.link_ms = link_ms;
+  std::vector<char> binary(static_cast<std::size_t>(size));
+  GLsizei written = 0;
+  glGetProgramBinary(program, size, &written, &h.format, binary.data());
+  h.size = static_cast<std::uint32_t>(written);
+
+  std::error_code ec;
+  std::filesystem::create_directories(directory, ec);
+  std::ofstream ofs(entry(key), std::ios::binary | std::ios::trunc);
+  ofs.write(reinterpret_cast<const char *>(&h), sizeof(h));
+  ofs.write(binary.data(), written);
+  if (!ofs) {
+    LOGGER_WARN("[PROGRAM CACHE] Could not write {0}", entry(key).string());
+  }
+}
+
+// the binary from program_cache, or compiles and links the stages found
+// next to program_name and caches the result
+GLuint link_program(const std::string &program_name) {
   namespace fs = std::filesystem;
+  const auto map_stage = [&](const std::string &path) {
+    utils::mapped_file source(path);
+    if (!source.is_open()) {
+      LOGGER_ERROR("[FILE] Cannot read {0}", path);
+    }
+    return source;
+  };
+
+  // every stage is mapped up front, the cache key covers all of them
+  const auto vert_source = map_stage(program_name + ".vert");
+  const auto frag_source = map_stage(program_name + ".frag");
   // optional stages
+  std::optional<utils::mapped_file> tesc_source;
+  std::optional<utils::mapped_file> tese_source;
+  if (fs::exists(program_name + ".tesc")) {
+    tesc_source = map_stage(program_name + ".tesc");
+  }
+  if (fs::exists(program_name + ".tese")) {
+    tese_source = map_stage(program_name + ".tese");
+  }
+
+  const std::string_view sources[] = {
+      vert_source.text(), frag_source.text(),
+      tesc_source ? tesc_source->text() : std::string_view{},
+      tese_source ? tese_source->text() : std::string_view{}};
+  const auto key = glfw_impl::program_cache::key(sources);
+  const auto saved = glfw_impl::program_cache::saved_ms();
+  if (const auto cached = glfw_impl::program_cache::load(key)) {
+    LOGGER_INFO("[PROGRAM] Loaded {0} from the binary cache, {1:.2f} ms saved",
+                program_name, glfw_impl::program_cache::saved_ms() - saved);
+    return cached.value();
+  }
+
+  const auto start = std::chrono::steady_clock::now();
   std::optional<GLuint> tesc_shader;
   std::optional<GLuint> tese_shader;
 
-  std::string vert_source =
-      utils::read_text_file((program_name + ".vert").c_str());
-  std::string frag_source =
-      utils::read_text_file((program_name + ".frag").c_str());
-
-  if (fs::exists(program_name + ".tesc")) {
-    std::string tesc_source =
-        utils::read_text_file((program_name + ".tesc").c_str());
-    tesc_shader =
-        compile_shader_from_source(tesc_source, GL_TESS_CONTROL_SHADER);
+  if (tesc_source.has_value()) {
+    tesc_shader = compile_shader_from_source(tesc_source->text(),
+                                             GL_TESS_CONTROL_SHADER);
   }
 
-  if (fs::exists(program_name + ".tese")) {
-    std::string tese_source =
-        utils::read_text_file((program_name + ".tese").c_str());
-    tese_shader =
-        compile_shader_from_source(tese_source, GL_TESS_EVALUATION_SHADER);
+  if (tese_source.has_value()) {
+    tese_shader = compile_shader_from_source(tese_source->text(),
+                                             GL_TESS_EVALUATION_SHADER);
   }
 
   GLuint vertex_shader =
-      compile_shader_from_source(vert_source, GL_VERTEX_SHADER);
+      compile_shader_from_source(vert_source.text(), GL_VERTEX_SHADER);
   GLuint frag_shader =
-      compile_shader_from_source(frag_source, GL_FRAGMENT_SHADER);
+      compile_shader_from_source(frag_source.text(), GL_FRAGMENT_SHADER);
 
   GLuint program = glCreateProgram();
+  glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 
   glAttachShader(program, vertex_shader);
   glAttachShader(program, frag_shader);
@@ -380,18 +524,101 @@ void glfw_impl::add_program_to_renderable(const std::string &program_name,
   glDeleteShader(vertex_shader);
   glDeleteShader(frag_shader);
 
-  if (tesc_shader.has_value() && tese_shader.has_value()) {
+  if (tesc_shader.has_value()) {
     glDeleteShader(tesc_shader.value());
+  }
+  if (tese_shader.has_value()) {
     glDeleteShader(tese_shader.value());
   }
-  out.program = program;
+
+  const auto link_ms = ms_since(start);
+  if (plinked == GL_TRUE) {
+    glfw_impl::program_cache::store(key, program, link_ms);
+  }
+  LOGGER_INFO("[PROGRAM] Linked {0} in {1:.2f} ms", program_name, link_ms);
+  return program;
 }
 
-void glfw_impl::use_program(GLuint program) { glUseProgram(program); }
+// every active uniform of the default block of a linked program
+void reflect_uniforms(glfw_impl::program_registry::entry &e) {
+  GLint count = 0;
+  GLint max_length = 0;
+  glGetProgramiv(e.program, GL_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv(e.program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+  std::string name(static_cast<std::size_t>(std::max(max_length, 1)), '\0');
+  for (GLint i = 0; i < count; ++i) {
+    GLsizei length = 0;
+    GLint size = 0;
+    GLenum type = 0;
+    glGetActiveUniform(e.program, static_cast<GLuint>(i), max_length,
+                       &length, &size, &type, name.data());
+    const std::string uniform_name(name.data(), length);
+    const GLint location =
+        glGetUniformLocation(e.program, uniform_name.c_str());
+    // members of uniform blocks have no location
+    if (location < 0) {
+      continue;
+    }
+    e.uniforms[uniform_name] = {location, type};
+    // arrays are reported as name[0]
+    if (uniform_name.ends_with("[0]")) {
+      e.uniforms[uniform_name.substr(0, uniform_name.size() - 3)] = {
+          location, type};
+    }
+  }
+}
+
+GLuint glfw_impl::program_registry::acquire(const std::string &name) {
+  auto [it, inserted] = programs.try_emplace(name);
+  auto &e = it->second;
+  if (inserted) {
+    e.program = link_program(name);
+    reflect_uniforms(e);
+  }
+  return e.program;
+}
+
+const glfw_impl::program_registry::active_uniform *
+glfw_impl::program_registry::find_uniform(GLuint program,
+                                          const std::string &name) {
+  for (const auto &[program_name, e] : programs) {
+    if (e.program != program) {
+      continue;
+    }
+    const auto it = e.uniforms.find(name);
+    return it == e.uniforms.end() ? nullptr : &it->second;
+  }
+  return nullptr;
+}
+
+void glfw_impl::program_registry::use(GLuint program) {
+  if (bound == program) {
+    ++current.skipped;
+    return;
+  }
+  glUseProgram(program);
+  bound = program;
+  ++current.binds;
+}
+
+void glfw_impl::program_registry::new_frame() {
+  previous = current;
+  current = {};
+  bound.reset();
+}
+
+void glfw_impl::add_program_to_renderable(const std::string &program_name,
+                                          renderable &out) {
+  out.program = program_registry::acquire(program_name);
+}
+
+void glfw_impl::use_program(GLuint program) { program_registry::use(program); }
 
 void glfw_impl::render(const renderable &meta,
                        const api_agnostic_geometry &geom, render_mode mode) {
   glBindVertexArray(meta.vao.value());
+  ++frame_render_stats.vao_binds;
+  ++frame_render_stats.draw_calls;
   glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
   if (mode == render_mode::triangles) {
     glDrawElements(GL_TRIANGLES, geom.indices.size(), GL_UNSIGNED_INT, NULL);
@@ -404,4 +631,132 @@ void glfw_impl::render(const renderable &meta,
   }
 }
 
+void glfw_impl::merged_mesh::clear() {
+  parts.clear();
+  vertices.clear();
+  vertex_parts.clear();
+  indices.clear();
+}
+
+std::size_t
+glfw_impl::merged_mesh::add(const api_agnostic_geometry &geometry,
+                            bool double_sided) {
+  part p;
+  p.first_index = static_cast<GLuint>(indices.size());
+  p.base_vertex = static_cast<GLint>(vertices.size());
+  vertices.insert(vertices.end(), geometry.vertices.begin(),
+                  geometry.vertices.end());
+  vertex_parts.insert(vertex_parts.end(), geometry.vertices.size(),
+                      static_cast<GLuint>(parts.size()));
+  // indices stay relative to the part, base_vertex offsets them
+  indices.insert(indices.end(), geometry.indices.begin(),
+                 geometry.indices.end());
+  if (double_sided) {
+    for (std::size_t i = 0; i + 2 < geometry.indices.size(); i += 3) {
+      indices.push_back(geometry.indices[i]);
+      indices.push_back(geometry.indices[i + 2]);
+      indices.push_back(geometry.indices[i + 1]);
+    }
+  }
+  p.count = static_cast<GLuint>(indices.size()) - p.first_index;
+  parts.push_back(p);
+  return parts.size() - 1;
+}
+
+void glfw_impl::merged_mesh::upload() {
+  fill_renderable(vertices, indices, meta);
+
+  // part index of every vertex, from a second vertex buffer
+  if (!part_buffer.has_value()) {
+    GLuint tmp;
+    glCreateBuffers(1, &tmp);
+    part_buffer = tmp;
+  }
+  glNamedBufferData(part_buffer.value(), sizeof(GLuint) * vertex_parts.size(),
+                    vertex_parts.data(), GL_STATIC_DRAW);
+  const auto vao = meta.vao.value();
+  glVertexArrayVertexBuffer(vao, 1, part_buffer.value(), 0, sizeof(GLuint));
+  glEnableVertexArrayAttrib(vao, part_attribute);
+  glVertexArrayAttribIFormat(vao, part_attribute, 1, GL_UNSIGNED_INT, 0);
+  glVertexArrayAttribBinding(vao, part_attribute, 1);
+
+  // the commands depend on the parts
+  command_copies = 0;
+}
+
+void glfw_impl::merged_mesh::prepare_commands(std::size_t copies,
+                                              bool instanced) {
+  if (!command_buffer.has_value()) {
+    GLuint tmp[2];
+    glCreateBuffers(2, tmp);
+    command_buffer = tmp[0];
+    matrix_buffer = tmp[1];
+  }
+  if (copies == command_copies && instanced == instanced_commands) {
+    return;
+  }
+  std::vector<draw_elements_command> cmds;
+  if (instanced) {
+    // draw i is part i, instance j of it is copy j
+    for (const auto &p : parts) {
+      cmds.push_back({p.count, static_cast<GLuint>(copies), p.first_index,
+                      p.base_vertex, 0});
+    }
+  } else {
+    // draw i of the call is part i % parts of copy i / parts, gl_DrawID
+    // is its matrix
+    cmds.reserve(copies * parts.size());
+    for (std::size_t c = 0; c < copies; ++c) {
+      for (const auto &p : parts) {
+        cmds.push_back({p.count, 1, p.first_index, p.base_vertex, 0});
+      }
+    }
+  }
+  glNamedBufferData(command_buffer.value(),
+                    sizeof(draw_elements_command) * cmds.size(), cmds.data(),
+                    GL_STATIC_DRAW);
+  command_copies = copies;
+  instanced_commands = instanced;
+}
+
+void glfw_impl::merged_mesh::submit(std::size_t commands) {
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer.value());
+  glBindVertexArray(meta.vao.value());
+  ++frame_render_stats.vao_binds;
+  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+  glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr,
+                              static_cast<GLsizei>(commands), 0);
+  ++frame_render_stats.draw_calls;
+}
+
+void glfw_impl::merged_mesh::draw(std::span<const math::mat4> matrices) {
+  const auto copies = parts.empty() ? 0 : matrices.size() / parts.size();
+  if (copies == 0) {
+    return;
+  }
+  const auto count = copies * parts.size();
+
+  prepare_commands(copies, false);
+  if (count > matrix_capacity) {
+    glNamedBufferData(matrix_buffer.value(), sizeof(math::mat4) * count,
+                      nullptr, GL_DYNAMIC_DRAW);
+    matrix_capacity = count;
+  }
+  glNamedBufferSubData(matrix_buffer.value(), 0, sizeof(math::mat4) * count,
+                       matrices.data());
+  ++frame_render_stats.uploads;
+
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, matrices_binding,
+                   matrix_buffer.value());
+  submit(count);
+}
+
+void glfw_impl::merged_mesh::draw_instanced(std::size_t copies) {
+  if (parts.empty() || copies == 0) {
+    return;
+  }
+  prepare_commands(copies, true);
+  submit(parts.size());
+}
+
 } // namespace pusn
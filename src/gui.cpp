@@ -13,16 +13,25 @@
 
 #include <ImGuiFileDialog.h>
 
+#include <gcode.hpp>
 #include <inverse_kinematics.hpp>
+#include <motion_program.hpp>
+#include <reachability.hpp>
+#include <toolpath.hpp>
+#include <trajectory.hpp>
 
 namespace pusn {
 namespace gui {
 
 struct gui_info {
   static std::string file_error_message;
+  // set when loading fails, the popup is opened from render_popups so it
+  // shares its ID stack
+  static bool show_file_error;
 };
 
 std::string gui_info::file_error_message{""};
+bool gui_info::show_file_error{false};
 
 // utility structure for realtime plot
 struct ScrollingBuffer {
@@ -238,13 +247,25 @@ void update_viewport_info(std::function<void(void)> process_input) {
   ImGui::End();
 }
 
-void render_performance_window() {
+void render_performance_window(interpolator_scene &scene) {
   ImGui::Begin("Frame Statistics");
   ShowDemo_RealtimePlots();
   ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
               1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
   ImGui::Text("Last CPU frame %.3lf ms",
               glfw_impl::last_frame_info::last_frame_time);
+  const auto &programs = glfw_impl::program_registry::last_frame();
+  ImGui::Text("%zu shader programs, %zu binds (%zu skipped)",
+              glfw_impl::program_registry::size(), programs.binds,
+              programs.skipped);
+  const auto &render = glfw_impl::last_frame_info::render;
+  ImGui::Text("%zu draw calls, %zu VAO binds, %zu uniform uploads",
+              render.draw_calls, render.vao_binds, render.uploads);
+  ImGui::Text("Program binary cache saved %.1f ms at startup",
+              glfw_impl::program_cache::saved_ms());
+  // forward kinematics in the vertex shader, one joints upload per robot
+  // instead of a matrix per part
+  ImGui::Checkbox("GPU skinning", &scene.gpu_skinning);
   ImGui::End();
 }
 
@@ -308,18 +329,38 @@ void render_simulation_gui(internal::model &model) {
     model.next_settings.quat_rotation_end = glm::quat(glm::radians(end_angle));
   }
 
-  auto cpos = get_actuator_pos(model.left_puma);
+  auto cpos = forward_kinematics(model.left_puma).pos;
   ImGui::Text("Left actuator: %f, %f, %f", cpos.x, cpos.y, cpos.z);
 
-  auto rcpos = get_actuator_pos(model.right_puma);
+  auto rcpos = forward_kinematics(model.right_puma).pos;
   ImGui::Text("Right actuator: %f, %f, %f", rcpos.x, rcpos.y, rcpos.z);
 
-  if (ImGui::Button("Run")) {
+  ImGui::Checkbox("Refine IK", &model.next_settings.refine_ik);
+  ImGui::Text("Right residual: %g", model.right_puma_residual);
+
+  // playback starts with the first chunk, the rest bakes while it plays
+  if (model.trajectory && !model.trajectory->complete()) {
+    ImGui::ProgressBar(model.trajectory->progress(), ImVec2(-1.f, 0.f),
+                       "Baking trajectory");
+  }
 
-    model.current_settings = model.next_settings;
-    model.current_settings.value().start_time =
-        std::chrono::system_clock::now();
+  // precomputed by puma_reachability, answers without running IK
+  static const auto reachability =
+      reachability_volume::load("resources/reachability.bin");
+  if (reachability && reachability->matches(model.left_puma)) {
+    const auto &next = model.next_settings;
+    ImGui::Text("Start %s, end %s",
+                reachability->reachable(next.position_start,
+                                        next.quat_rotation_start)
+                    ? "reachable"
+                    : "unreachable",
+                reachability->reachable(next.position_end,
+                                        next.quat_rotation_end)
+                    ? "reachable"
+                    : "unreachable");
+  }
 
+  if (ImGui::Button("Run")) {
     auto solutions_start =
         solve_task(model, {model.next_settings.position_start,
                            model.next_settings.quat_rotation_start});
@@ -327,10 +368,187 @@ void render_simulation_gui(internal::model &model) {
         solve_task(model, {model.next_settings.position_end,
                            model.next_settings.quat_rotation_end});
 
-    model.current_settings.value().start_state = solutions_start[0];
-    model.current_settings.value().end_state = solutions_end[0];
+    if (solutions_start.empty() || solutions_end.empty()) {
+      LOGGER_WARN("Cannot run, the {0} pose is unreachable",
+                  solutions_start.empty() ? "start" : "end");
+    } else {
+      model.current_settings = model.next_settings;
+      model.current_settings.value().start_time =
+          std::chrono::system_clock::now();
+
+      model.current_settings.value().start_state = solutions_start[0];
+      model.current_settings.value().end_state = solutions_end[0];
+
+      model.right_puma = solutions_start[0];
+      model.right_puma_tracking.reset();
+      model.program.reset();
+    }
+  }
 
-    model.right_puma = solutions_start[0];
+  // robot program - every waypoint is reached "Length" seconds after the
+  // previous one, starting from the start pose
+  ImGui::Separator();
+  if (changed) {
+    model.clear_solved();
+  }
+  ImGui::Text("Program: %zu waypoints%s", model.waypoints.size(),
+              model.waypoint_states.empty() ? "" : ", solved");
+  if (ImGui::Button("Add End Pose")) {
+    model.waypoints.push_back({model.next_settings.position_end,
+                               model.next_settings.quat_rotation_end,
+                               model.next_settings.length});
+    model.clear_solved();
+  }
+  ImGui::SameLine();
+  if (ImGui::Button("Clear Program")) {
+    model.waypoints.clear();
+    model.clear_solved();
+  }
+
+  const auto program_path = [&]() {
+    std::vector<internal::waypoint> waypoints;
+    waypoints.reserve(model.waypoints.size() + 1);
+    waypoints.push_back({model.next_settings.position_start,
+                         model.next_settings.quat_rotation_start, 0.f});
+    waypoints.insert(waypoints.end(), model.waypoints.begin(),
+                     model.waypoints.end());
+    return waypoints;
+  };
+  // replaces the program, its first waypoint becomes the start pose
+  const auto use_program = [&](std::vector<internal::waypoint> &&waypoints) {
+    model.next_settings.position_start = waypoints.front().position;
+    model.next_settings.quat_rotation_start = waypoints.front().rotation;
+    start_angle =
+        glm::degrees(glm::eulerAngles(waypoints.front().rotation));
+    model.waypoints.assign(waypoints.begin() + 1, waypoints.end());
+  };
+
+  ImGui::SameLine();
+  if (!model.waypoints.empty() && ImGui::Button("Run Program")) {
+    model.current_settings.reset();
+    model.trajectory.reset();
+    model.right_puma_tracking.reset();
+    model.program = std::make_shared<program_runner>(
+        program_path(), model.left_puma, model.next_settings,
+        model.waypoint_states, model.waypoint_branches);
+    model.program->start();
+  }
+
+  // milling programs, placed in front of the robot and followed with the
+  // end orientation. A .pumapath file is a compiled program (see
+  // compiled_toolpath), it loads without IK
+  static std::string gcode_path{"resources/programs/paths1/t1.k16"};
+  static gcode_settings gcode;
+  ImGui::InputText("G-code File", &gcode_path);
+  ImGui::DragFloat("G-code Scale", &gcode.scale, 0.001f, 0.001f, 1.f);
+  ImGui::SliderFloat3("G-code Offset", glm::value_ptr(gcode.offset), -30.f,
+                      30.f);
+  ImGui::DragFloat("Feed Rate", &gcode.feed_rate, 1.f, 1.f, 1000.f);
+  const std::filesystem::path program_file{gcode_path};
+  if (ImGui::Button("Load G-code")) {
+    if (program_file.extension() == ".pumapath") {
+      auto toolpath = compiled_toolpath::load(program_file);
+      if (!toolpath || toolpath->size() == 0) {
+        gui_info::file_error_message =
+            "not a compiled toolpath or its checksum does not match";
+        gui_info::show_file_error = true;
+      } else {
+        use_program(toolpath->waypoints());
+        // joints solved for other link lengths are of no use
+        model.clear_solved();
+        if (toolpath->matches(model.left_puma)) {
+          model.waypoint_states = toolpath->states(model.left_puma);
+          model.waypoint_branches.assign(toolpath->branches().begin(),
+                                         toolpath->branches().end());
+        }
+        LOGGER_INFO("Loaded {0} compiled moves from {1}{2}",
+                    model.waypoints.size(), gcode_path,
+                    model.waypoint_states.empty() ? ", solving again" : "");
+      }
+    } else {
+      gcode.tool_rotation = model.next_settings.quat_rotation_end;
+      std::vector<internal::waypoint> waypoints;
+      std::string error;
+      if (!load_gcode(program_file, gcode, waypoints, error)) {
+        gui_info::file_error_message = error;
+        gui_info::show_file_error = true;
+      } else if (!waypoints.empty()) {
+        // the program starts at its first point
+        use_program(std::move(waypoints));
+        model.clear_solved();
+        LOGGER_INFO("Loaded {0} moves from {1}", model.waypoints.size(),
+                    gcode_path);
+      }
+    }
+  }
+  // played while it is read, only the lookahead is ever in memory. Kept
+  // for its progress as long as the runner it feeds is the model's program
+  static std::shared_ptr<gcode_stream> stream;
+  static std::weak_ptr<program_runner> streamed;
+  ImGui::SameLine();
+  if (program_file.extension() != ".pumapath" &&
+      ImGui::Button("Stream G-code")) {
+    gcode.tool_rotation = model.next_settings.quat_rotation_end;
+    auto opened = std::make_shared<gcode_stream>(program_file, gcode);
+    if (!opened->is_open()) {
+      gui_info::file_error_message = opened->error();
+      gui_info::show_file_error = true;
+    } else {
+      stream = std::move(opened);
+      model.current_settings.reset();
+      model.trajectory.reset();
+      model.right_puma_tracking.reset();
+      model.program = std::make_shared<program_runner>(
+          [source = stream](internal::waypoint &w) { return (*source)(w); },
+          model.left_puma, model.next_settings);
+      model.program->start();
+      streamed = model.program;
+    }
+  }
+  if (stream && stream->finished() && !stream->error().empty()) {
+    LOGGER_ERROR("{0}: {1}", gcode_path, stream->error());
+    gui_info::file_error_message = stream->error();
+    gui_info::show_file_error = true;
+    stream.reset();
+  }
+  // another program replaced it, or it played to the end
+  if (stream && (!model.program || streamed.lock() != model.program ||
+                 model.program->done())) {
+    stream.reset();
+    streamed.reset();
+  }
+  ImGui::SameLine();
+  if (!model.waypoints.empty() && ImGui::Button("Compile Program")) {
+    auto output = program_file;
+    output.replace_extension(".pumapath");
+    const auto toolpath =
+        compiled_toolpath::compile(model.left_puma, program_path());
+    if (toolpath.save(output)) {
+      model.waypoint_states = toolpath.states(model.left_puma);
+      model.waypoint_branches.assign(toolpath.branches().begin(),
+                                     toolpath.branches().end());
+      LOGGER_INFO("Compiled {0} moves into {1}, {2} unreachable",
+                  model.waypoints.size(), output.string(),
+                  toolpath.unreachable());
+    } else {
+      LOGGER_ERROR("Could not write {0}", output.string());
+    }
+  }
+
+  if (model.program) {
+    ImGui::Text("Segment %zu, %zu prepared of %zu waypoints read%s",
+                model.program->handed_out.load(),
+                model.program->prepared.load(),
+                model.program->waypoints_read.load(),
+                model.program->done() ? ", done" : "");
+    ImGui::Text("%zu unreachable, %zu underruns (%zu ticks)",
+                model.program->unreachable.load(),
+                model.program->underrun_events.load(),
+                model.program->underruns.load());
+    if (stream && stream->size > 0) {
+      ImGui::ProgressBar(static_cast<float>(stream->bytes_read.load()) /
+                         static_cast<float>(stream->size));
+    }
   }
 
   ImGui::End();
@@ -357,7 +575,7 @@ void render_converter() {
 }
 
 void render(input_state &input, interpolator_scene &scene) {
-  render_performance_window();
+  render_performance_window(scene);
   render_light_gui(scene.light);
   render_simulation_gui(scene.model);
   render_converter();
@@ -387,6 +605,11 @@ void render_popups() {
   ImVec2 center = ImGui::GetMainViewport()->GetCenter();
   ImGui::SetNextWindowPos(center, ImGuiCond_Appearing, ImVec2(0.5f, 0.5f));
 
+  if (gui_info::show_file_error) {
+    ImGui::OpenPopup("File Corrupted");
+    gui_info::show_file_error = false;
+  }
+
   if (ImGui::BeginPopupModal("File Corrupted", NULL,
                              ImGuiWindowFlags_AlwaysAutoResize)) {
     ImGui::Text("The file you have pointed to is corrupted or wrongly "
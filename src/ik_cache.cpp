@@ -0,0 +1,99 @@
+#include <ik_cache.hpp>
+
+#include <bit>
+#include <cmath>
+
+namespace pusn {
+
+namespace {
+
+// splitmix64 finalizer, spreads neighbouring cells over the whole table
+inline std::uint64_t mix(std::uint64_t h) {
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ull;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebull;
+  h ^= h >> 31;
+  return h;
+}
+
+template <typename Key> inline std::uint64_t hash(const Key &k) {
+  std::uint64_t h = 0;
+  for (auto v : k) {
+    h = mix(h ^ static_cast<std::uint32_t>(v));
+  }
+  return h;
+}
+
+inline std::int32_t quantize_component(float v, float step) {
+  return static_cast<std::int32_t>(std::lround(v / step));
+}
+
+} // namespace
+
+ik_cache::ik_cache(std::size_t capacity, float position_step,
+                   float rotation_step)
+    : slots(std::bit_ceil(std::max<std::size_t>(capacity, max_probe))),
+      mask(slots.size() - 1), pos_step(position_step),
+      rot_step(rotation_step) {}
+
+ik_cache::key ik_cache::quantize(const puma_pos &settings) const {
+  // q and -q are the same orientation
+  const auto q = settings.rot.w < 0.f ? -settings.rot : settings.rot;
+  return {quantize_component(settings.pos.x, pos_step),
+          quantize_component(settings.pos.y, pos_step),
+          quantize_component(settings.pos.z, pos_step),
+          quantize_component(q.w, rot_step),
+          quantize_component(q.x, rot_step),
+          quantize_component(q.y, rot_step),
+          quantize_component(q.z, rot_step)};
+}
+
+void ik_cache::clear() {
+  for (auto &s : slots) {
+    s.occupied = false;
+  }
+  used = 0;
+}
+
+const ik_solutions &ik_cache::solve(const internal::puma_state &robot,
+                                    const puma_pos &settings) {
+  const glm::vec3 robot_links{robot.l1, robot.l3, robot.l4};
+  if (robot_links != links) {
+    clear();
+    links = robot_links;
+  }
+
+  const auto k = quantize(settings);
+  const auto home = hash(k) & mask;
+
+  auto target = home;
+  bool found_free = false;
+  for (std::size_t i = 0; i < max_probe; ++i) {
+    auto &s = slots[(home + i) & mask];
+    if (!s.occupied) {
+      target = (home + i) & mask;
+      found_free = true;
+      break;
+    }
+    if (s.k == k) {
+      ++counters.hits;
+      return s.solutions;
+    }
+  }
+
+  ++counters.misses;
+  if (found_free) {
+    ++used;
+  } else {
+    ++counters.evictions;
+  }
+
+  auto &s = slots[target];
+  s.k = k;
+  s.occupied = true;
+  s.solutions = solve_task(robot, settings);
+  return s.solutions;
+}
+
+} // namespace pusn
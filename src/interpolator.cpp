@@ -1,16 +1,18 @@
 #include <interpolator.hpp>
 #include <logger.hpp>
 
+#include <chrono>
 #include <iostream>
 
 #include <gui.hpp>
 
 namespace pusn {
 
-bool interpolator::init(const std::string &window_title) {
+bool interpolator::init(const std::string &window_title, sim_clock clock) {
   bool final_result{true};
   final_result &= logger::init();
   window = chosen_api::initialize(window_title, &input);
+  scene.clock = clock;
   final_result &= scene.init();
   final_result &= gui::init(window);
   viewport.setup();
@@ -36,7 +38,7 @@ void interpolator::render_viewport() {
   glViewport(0, 0, chosen_api::last_frame_info::left_viewport_area.x,
              chosen_api::last_frame_info::left_viewport_area.y);
   chosen_api::clear_color_and_depth(clear_color, 1.f);
-  scene.render(input, true);
+  scene.render(input, scene.snapshot(), true);
   GLuint t = viewport.color_left.value();
   ImGui::Image((void *)(uint64_t)t, s, {0, 1}, {1, 0});
   viewport.unbind();
@@ -55,7 +57,7 @@ void interpolator::render_viewport() {
   glViewport(0, 0, chosen_api::last_frame_info::right_viewport_area.x,
              chosen_api::last_frame_info::right_viewport_area.y);
   chosen_api::clear_color_and_depth(clear_color, 1.f);
-  scene.render(input, false);
+  scene.render(input, scene.snapshot(), false);
   viewport.unbind();
   t = viewport.color_right.value();
   ImGui::Image((void *)(uint64_t)t, s, {0, 1}, {1, 0});
@@ -66,10 +68,17 @@ void interpolator::render_viewport() {
 }
 
 bool interpolator::main_loop() {
+  auto last_frame = std::chrono::system_clock::now();
   while (!chosen_api::should_close(window)) {
     chosen_api::before_frame();
     gui::start_frame();
     gui::update_viewport_info([&]() { input.process_new_input(); });
+
+    // the simulation steps once, both viewports draw the same snapshot
+    const auto now = std::chrono::system_clock::now();
+    scene.update(std::chrono::duration<float>(now - last_frame).count());
+    last_frame = now;
+
     render_viewport();
     render_gui();
     gui::end_frame();
@@ -1,39 +1,174 @@
 #include <interpolator_scene.hpp>
 
+#include <algorithm>
 #include <vector>
 
 #include <math.hpp>
 
+#include <kinematic_chain.hpp>
 #include <mock_data.hpp>
 
-#include <inverse_kinematics.hpp>
+#include <motion_program.hpp>
+#include <simulation.hpp>
+#include <trajectory.hpp>
 
 namespace pusn {
 
 void generate_milling_tool(api_agnostic_geometry &out) {}
 
+interpolator_scene::interpolator_scene() = default;
+interpolator_scene::~interpolator_scene() = default;
+
 bool interpolator_scene::init() {
   // Generate and add milling tool
   model.reset();
+  baker = std::make_unique<trajectory_baker>();
+
+  if (threaded_simulation) {
+    simulation = std::make_unique<simulation_thread>(clock);
+    simulation->start();
+  }
 
   // ADD GRID
   glfw_impl::fill_renderable(grid.geometry.vertices, grid.geometry.indices,
                              grid.api_renderable);
   glfw_impl::add_program_to_renderable("resources/grid", grid.api_renderable);
+  grid.uniforms.resolve(grid.api_renderable.program.value());
+  per_view.create(internal::per_view_block::binding);
+  joints.create(internal::skinning_joints::binding);
 
   return true;
 }
 
-void interpolator_scene::set_light_uniforms(input_state &input,
-                                            glfw_impl::renderable &r) {
-  // set light and camera uniforms
-  glfw_impl::set_uniform("light_pos", r.program.value(),
-                         light.placement.position);
-  glfw_impl::set_uniform("light_color", r.program.value(), light.color);
-  glfw_impl::set_uniform("cam_pos", r.program.value(), input.camera.pos);
+void interpolator_scene::set_view_uniforms(input_state &input,
+                                           const math::mat4 &view,
+                                           const math::mat4 &proj) {
+  internal::per_view_block block;
+  block.view = view;
+  block.proj = proj;
+  block.light_pos = math::vec4(light.placement.position, 1.f);
+  block.light_color = math::vec4(light.color, 1.f);
+  block.cam_pos = math::vec4(input.camera.pos, 1.f);
+  per_view.update(block);
+}
+
+void interpolator_scene::update(float dt) {
+  auto &f = current_frame;
+  f.dt = dt;
+  ++f.frame;
+
+  if (simulation) {
+    sync_simulation();
+  } else {
+    step_simulation(dt);
+  }
+
+  f.ik_puma = model.right_puma;
+  f.joint_puma = model.left_puma;
+  f.gpu_skinning = gpu_skinning;
+  if (!f.gpu_skinning) {
+    f.ik_skinning = kinematics::puma_chain::skinning<float>(f.ik_puma);
+    f.joint_skinning = kinematics::puma_chain::skinning<float>(f.joint_puma);
+  }
+}
+
+bool interpolator_scene::pick_up_move() {
+  // a program starts with its first segment once that is prepared, the
+  // ones after it are picked up by animate
+  prepared_segment first;
+  if (!model.current_settings && model.program && model.program->next(first)) {
+    model.current_settings = first.settings;
+    model.current_settings->start_time = std::chrono::system_clock::now();
+    model.trajectory = std::move(first.trajectory);
+  }
+  if (!model.current_settings) {
+    waiting_for_bake = false;
+    return false;
+  }
+  // the GUI starts a move by filling model.current_settings, the robot
+  // holds still until the first chunk of it is baked
+  if (model.current_settings->start_time != submitted_start) {
+    submitted_start = model.current_settings->start_time;
+    if (!model.program) {
+      model.trajectory = baker->bake(*model.current_settings,
+                                     model.left_puma, model.right_puma);
+    }
+    waiting_for_bake = true;
+    // whatever the simulation thread is still playing is not taken anymore
+    submitted_finished = true;
+  }
+  if (waiting_for_bake && model.trajectory->playable()) {
+    waiting_for_bake = false;
+    return true;
+  }
+  return false;
+}
+
+void interpolator_scene::step_simulation(float dt) {
+  // a move started from the GUI carries a wall clock start time, it is
+  // moved onto the simulation clock once it starts playing
+  if (pick_up_move()) {
+    model.current_settings->start_time = clock.now();
+    submitted_start = clock.now();
+  }
+  if (waiting_for_bake) {
+    return;
+  }
+
+  if (clock.kind == sim_clock::mode::real_time) {
+    animate(model, clock.advance());
+    return;
+  }
+  if (clock.kind == sim_clock::mode::as_fast_as_possible) {
+    // runs the move through in as few frames as the budget allows, a
+    // single step per frame would play it at one step per frame
+    const auto deadline = std::chrono::steady_clock::now() + fast_step_budget;
+    do {
+      animate(model, clock.advance());
+    } while (model.current_settings &&
+             std::chrono::steady_clock::now() < deadline);
+    return;
+  }
+
+  // fixed steps only, whatever the frame time - the remainder carries over
+  // to the next frame so the move keeps wall clock speed on average
+  pending_time += std::chrono::duration_cast<sim_clock::duration>(
+      std::chrono::duration<float>(dt));
+  const auto step = std::max(clock.step, sim_clock::duration{1});
+  while (pending_time >= step) {
+    pending_time -= step;
+    animate(model, clock.advance());
+  }
 }
 
-void interpolator_scene::render(input_state &input, bool left) {
+void interpolator_scene::sync_simulation() {
+  if (pick_up_move()) {
+    submitted_command = simulation->submit(model);
+    submitted_finished = false;
+  }
+
+  if (!simulation->poll()) {
+    return;
+  }
+  // only states of the move the GUI started are taken, the robots keep
+  // their GUI-edited joints when idle
+  const auto &s = simulation->latest();
+  if (submitted_finished || s.command_id != submitted_command) {
+    return;
+  }
+  model.left_puma = s.left_puma;
+  model.right_puma = s.right_puma;
+  model.right_puma_residual = s.right_puma_residual;
+  if (!s.running) {
+    model.current_settings.reset();
+    model.trajectory.reset();
+    model.program.reset();
+    submitted_finished = true;
+  }
+}
+
+void interpolator_scene::render(input_state &input,
+                                const frame_snapshot &frame, bool left) {
 
   // 1. get camera info
   glDepthFunc(GL_LESS);
@@ -48,6 +183,8 @@ void interpolator_scene::render(input_state &input, bool left) {
       left ? glfw_impl::last_frame_info::left_viewport_area.y
            : glfw_impl::last_frame_info::right_viewport_area.y,
       input.render_info.clip_near, input.render_info.clip_far);
+  // the same for every draw of the viewport
+  set_view_uniforms(input, view, proj);
 
   // 2. render grid
   glDisable(GL_CULL_FACE);
@@ -55,199 +192,48 @@ void interpolator_scene::render(input_state &input, bool left) {
       math::get_model_matrix(grid.placement.position, grid.placement.scale,
                              math::deg_to_rad(grid.placement.rotation));
   glfw_impl::use_program(grid.api_renderable.program.value());
-
-  set_light_uniforms(input, grid.api_renderable);
-
-  glfw_impl::set_uniform("model", grid.api_renderable.program.value(),
-                         model_grid_m);
-  glfw_impl::set_uniform("view", grid.api_renderable.program.value(), view);
-  glfw_impl::set_uniform("proj", grid.api_renderable.program.value(), proj);
+  glfw_impl::set_uniform(grid.uniforms.model, model_grid_m);
   glfw_impl::render(grid.api_renderable, grid.geometry);
   glEnable(GL_CULL_FACE);
 
-  // 3. render the model
-  const auto time = std::chrono::system_clock::now();
-  if (model.current_settings.has_value()) {
-    // UPDATE
-
-    std::chrono::duration<float> elapsed_seconds =
-        time - model.current_settings.value().start_time;
-    const float progress =
-        elapsed_seconds.count() / model.current_settings.value().length;
-
-    if (progress > 1.0) {
-      model.current_settings.reset();
-    } else {
-      // left puma - linear interpolation of start and end config
-      auto &start = model.current_settings.value().start_state;
-      auto &end = model.current_settings.value().end_state;
-      model.left_puma = internal::lerp(start, end, progress);
-
-      // right puma - find inverse solution for each position
-      auto &pos_start = model.current_settings.value().position_start;
-      auto &rot_start = model.current_settings.value().quat_rotation_start;
-      auto &pos_end = model.current_settings.value().position_end;
-      auto &rot_end = model.current_settings.value().quat_rotation_end;
-
-      auto curr_pos = glm::mix(pos_start, pos_end, progress);
-      auto curr_rot = glm::slerp(rot_start, rot_end, progress);
-
-      auto solutions = solve_task(model, {curr_pos, curr_rot});
-      // find the closest to current right puma state
-      float closest_dist = internal::state_dist(model.right_puma, solutions[0]);
-      std::size_t closest_state = 0;
-      for (std::size_t i = 1; i < solutions.size(); ++i) {
-        if (internal::state_dist(model.right_puma, solutions[i]) <
-            closest_dist) {
-          closest_state = i;
-          closest_dist = internal::state_dist(model.right_puma, solutions[i]);
-        }
-      }
-
-      model.right_puma = solutions[closest_state];
-    }
+  // 3. render the model - the left viewport follows the IK solution, the
+  // right one the joint space interpolation, every part is drawn in its
+  // frame of the chain
+  const auto &puma = left ? frame.ik_puma : frame.joint_puma;
+  auto &mesh = model.renderable.mesh;
+  glfw_impl::use_program(mesh.meta.program.value());
+  glfw_impl::set_uniform(model.renderable.gpu_skinning, frame.gpu_skinning);
+
+  if (frame.gpu_skinning) {
+    // the shader walks the chain, the joints are all it needs
+    const auto robot = internal::skinning_joints::from(puma);
+    joints.update(std::span(&robot, 1));
+    mesh.draw_instanced(1);
+    return;
   }
 
-  auto render_element = [&](auto &renderable, auto &geometry, auto &mmat) {
-    glfw_impl::use_program(renderable.program.value());
-    set_light_uniforms(input, renderable);
-    glfw_impl::set_uniform("model", renderable.program.value(), mmat);
-    glfw_impl::set_uniform("view", renderable.program.value(), view);
-    glfw_impl::set_uniform("proj", renderable.program.value(), proj);
-    glfw_impl::render(renderable, geometry);
-    glfw_impl::use_program(0);
-  };
-
-  if (!left) {
-    glm::mat4 skinning_matrix = glm::mat4(1.f);
-    auto mmat =
-        math::get_model_matrix({0.f, 0.f, 0.f}, {5.f, 1.f, 5.f},
-                               math::deg_to_rad(glm::vec3{0.f, 0.f, 0.f}));
-    glDisable(GL_CULL_FACE);
-    render_element(model.renderable.base, model.geometry.base, mmat);
-    glEnable(GL_CULL_FACE);
-
-    mmat = math::get_model_matrix({0.f, 0.f, 0.f}, {1.f, 1.f, 1.f},
-                                  math::deg_to_rad(glm::vec3{0.f, 0.f, 0.f}));
-    render_element(model.renderable.arm_1, model.geometry.arm_1, mmat);
-
-    // joint 12
-    mmat = math::get_model_matrix(
-        {0.f, model.left_puma.l1, 0.f}, {1.f, 1.f, 1.f},
-        math::deg_to_rad(glm::vec3{0.f, model.left_puma.alpha_1, 0.f}));
-    skinning_matrix = mmat * skinning_matrix;
-    mmat = skinning_matrix * glm::translate(glm::mat4(1.f), {0.f, 0.f, 1.f});
-    render_element(model.renderable.joint_12, model.geometry.joint_12, mmat);
-
-    // arm2
-    mmat = math::get_model_matrix(
-        {0.f, 0.f, 0.f}, {1.f, 1.f, 1.f},
-        math::deg_to_rad(glm::vec3{0.f, 0.f, -model.left_puma.alpha_2}));
-    skinning_matrix = skinning_matrix * mmat;
-    mmat = skinning_matrix *
-           glm::scale(glm::mat4(1.f), {model.left_puma.q2 / 10.f, 1.f, 1.f});
-    render_element(model.renderable.arm_2, model.geometry.arm_2, mmat);
-
-    // joint23
-    mmat =
-        math::get_model_matrix({model.left_puma.q2, 0.f, 0.f}, {1.f, 1.f, 1.f},
-                               math::deg_to_rad(glm::vec3{0.f, 0.f, 0.f}));
-    skinning_matrix = skinning_matrix * mmat;
-    mmat = skinning_matrix * glm::translate(glm::mat4(1.f), {0.f, 0.f, 1.f});
-    render_element(model.renderable.joint_23, model.geometry.joint_23, mmat);
-
-    // arm3
-    mmat = math::get_model_matrix(
-        {0.f, 0.f, 0.f}, {1.f, 1.f, 1.f},
-        math::deg_to_rad(glm::vec3{0.f, 0.f, -model.left_puma.alpha_3}));
-    skinning_matrix = skinning_matrix * mmat;
-    render_element(model.renderable.arm_3, model.geometry.arm_3,
-                   skinning_matrix);
-
-    // arm4
-    mmat = math::get_model_matrix(
-        {0.f, -model.left_puma.l3, 0.f}, {1.f, 1.f, 1.f},
-        math::deg_to_rad(glm::vec3{0.f, model.left_puma.alpha_4, 0.f}));
-    skinning_matrix = skinning_matrix * mmat;
-    render_element(model.renderable.arm_4, model.geometry.arm_4,
-                   skinning_matrix);
-
-    // spikes
-    mmat = math::get_model_matrix(
-        {model.left_puma.l4, 0.f, 0.f}, {1.f, 1.f, 1.f},
-        math::deg_to_rad(glm::vec3{model.left_puma.alpha_5, 0.f, 0.f}));
-    skinning_matrix = skinning_matrix * mmat;
-    render_element(model.renderable.spike_x, model.geometry.spike_x,
-                   skinning_matrix);
-    render_element(model.renderable.spike_y, model.geometry.spike_y,
-                   skinning_matrix);
-    render_element(model.renderable.spike_z, model.geometry.spike_z,
-                   skinning_matrix);
-  } else {
-    glm::mat4 skinning_matrix = glm::mat4(1.f);
-    auto mmat =
-        math::get_model_matrix({0.f, 0.f, 0.f}, {5.f, 1.f, 5.f},
-                               math::deg_to_rad(glm::vec3{0.f, 0.f, 0.f}));
-    glDisable(GL_CULL_FACE);
-    render_element(model.renderable.base, model.geometry.base, mmat);
-    glEnable(GL_CULL_FACE);
-
-    mmat = math::get_model_matrix({0.f, 0.f, 0.f}, {1.f, 1.f, 1.f},
-                                  math::deg_to_rad(glm::vec3{0.f, 0.f, 0.f}));
-    render_element(model.renderable.arm_1, model.geometry.arm_1, mmat);
-
-    // joint 12
-    mmat = math::get_model_matrix(
-        {0.f, model.right_puma.l1, 0.f}, {1.f, 1.f, 1.f},
-        math::deg_to_rad(glm::vec3{0.f, model.right_puma.alpha_1, 0.f}));
-    skinning_matrix = mmat * skinning_matrix;
-    mmat = skinning_matrix * glm::translate(glm::mat4(1.f), {0.f, 0.f, 1.f});
-    render_element(model.renderable.joint_12, model.geometry.joint_12, mmat);
-
-    // arm2
-    mmat = math::get_model_matrix(
-        {0.f, 0.f, 0.f}, {1.f, 1.f, 1.f},
-        math::deg_to_rad(glm::vec3{0.f, 0.f, -model.right_puma.alpha_2}));
-    skinning_matrix = skinning_matrix * mmat;
-    mmat = skinning_matrix *
-           glm::scale(glm::mat4(1.f), {model.right_puma.q2 / 10.f, 1.f, 1.f});
-    render_element(model.renderable.arm_2, model.geometry.arm_2, mmat);
-
-    // joint23
-    mmat =
-        math::get_model_matrix({model.right_puma.q2, 0.f, 0.f}, {1.f, 1.f, 1.f},
-                               math::deg_to_rad(glm::vec3{0.f, 0.f, 0.f}));
-    skinning_matrix = skinning_matrix * mmat;
-    mmat = skinning_matrix * glm::translate(glm::mat4(1.f), {0.f, 0.f, 1.f});
-    render_element(model.renderable.joint_23, model.geometry.joint_23, mmat);
-
-    // arm3
-    mmat = math::get_model_matrix(
-        {0.f, 0.f, 0.f}, {1.f, 1.f, 1.f},
-        math::deg_to_rad(glm::vec3{0.f, 0.f, -model.right_puma.alpha_3}));
-    skinning_matrix = skinning_matrix * mmat;
-    render_element(model.renderable.arm_3, model.geometry.arm_3,
-                   skinning_matrix);
-
-    // arm4
-    mmat = math::get_model_matrix(
-        {0.f, -model.right_puma.l3, 0.f}, {1.f, 1.f, 1.f},
-        math::deg_to_rad(glm::vec3{0.f, model.right_puma.alpha_4, 0.f}));
-    skinning_matrix = skinning_matrix * mmat;
-    render_element(model.renderable.arm_4, model.geometry.arm_4,
-                   skinning_matrix);
-
-    // spikes
-    mmat = math::get_model_matrix(
-        {model.right_puma.l4, 0.f, 0.f}, {1.f, 1.f, 1.f},
-        math::deg_to_rad(glm::vec3{model.right_puma.alpha_5, 0.f, 0.f}));
-    skinning_matrix = skinning_matrix * mmat;
-    render_element(model.renderable.spike_x, model.geometry.spike_x,
-                   skinning_matrix);
-    render_element(model.renderable.spike_y, model.geometry.spike_y,
-                   skinning_matrix);
-    render_element(model.renderable.spike_z, model.geometry.spike_z,
-                   skinning_matrix);
-  }
+  using namespace kinematics;
+  const auto &skinning = left ? frame.ik_skinning : frame.joint_skinning;
+  const auto joint_offset = glm::translate(glm::mat4(1.f), {0.f, 0.f, 1.f});
+
+  std::array<math::mat4, internal::puma_part::count> parts;
+  parts[internal::puma_part::base] =
+      glm::scale(glm::mat4(1.f), {5.f, 1.f, 5.f});
+  parts[internal::puma_part::arm_1] = skinning[puma_link::base];
+  parts[internal::puma_part::joint_12] =
+      skinning[puma_link::joint_12] * joint_offset;
+  parts[internal::puma_part::arm_2] =
+      skinning[puma_link::arm_2] *
+      glm::scale(glm::mat4(1.f), {puma.q2 / 10.f, 1.f, 1.f});
+  parts[internal::puma_part::joint_23] =
+      skinning[puma_link::joint_23] * joint_offset;
+  parts[internal::puma_part::arm_3] = skinning[puma_link::arm_3];
+  parts[internal::puma_part::arm_4] = skinning[puma_link::arm_4];
+  // spikes
+  parts[internal::puma_part::spike_x] = skinning[puma_link::effector];
+  parts[internal::puma_part::spike_y] = skinning[puma_link::effector];
+  parts[internal::puma_part::spike_z] = skinning[puma_link::effector];
+
+  mesh.draw(parts);
 }
 } // namespace pusn
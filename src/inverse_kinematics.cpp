@@ -1,171 +1,825 @@
 #include <inverse_kinematics.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 namespace pusn {
 
-glm::vec3 get_actuator_pos(const internal::puma_state &state) {
-  glm::vec4 res{state.l4, 0.f, 0.f, 1.f};
-  glm::mat4 skinning_matrix = glm::mat4(1.f);
-  auto mmat =
-      math::get_model_matrix({0.f, 0.f, 0.f}, {5.f, 1.f, 5.f},
-                             math::deg_to_rad(glm::vec3{0.f, 0.f, 0.f}));
-
-  mmat = math::get_model_matrix({0.f, 0.f, 0.f}, {1.f, 1.f, 1.f},
-                                math::deg_to_rad(glm::vec3{0.f, 0.f, 0.f}));
-
-  mmat = math::get_model_matrix(
-      {0.f, state.l1, 0.f}, {1.f, 1.f, 1.f},
-      math::deg_to_rad(glm::vec3{0.f, state.alpha_1, 0.f}));
-  skinning_matrix = mmat * skinning_matrix;
-
-  // arm2
-  mmat = math::get_model_matrix(
-      {0.f, 0.f, 0.f}, {1.f, 1.f, 1.f},
-      math::deg_to_rad(glm::vec3{0.f, 0.f, -state.alpha_2}));
-  skinning_matrix = skinning_matrix * mmat;
-
-  // joint23
-  mmat = math::get_model_matrix({state.q2, 0.f, 0.f}, {1.f, 1.f, 1.f},
-                                math::deg_to_rad(glm::vec3{0.f, 0.f, 0.f}));
-  skinning_matrix = skinning_matrix * mmat;
-
-  // arm3
-  mmat = math::get_model_matrix(
-      {0.f, 0.f, 0.f}, {1.f, 1.f, 1.f},
-      math::deg_to_rad(glm::vec3{0.f, 0.f, -state.alpha_3}));
-  skinning_matrix = skinning_matrix * mmat;
-
-  // arm4
-  mmat = math::get_model_matrix(
-      {0.f, -state.l3, 0.f}, {1.f, 1.f, 1.f},
-      math::deg_to_rad(glm::vec3{0.f, state.alpha_4, 0.f}));
-  skinning_matrix = skinning_matrix * mmat;
-
-  auto pret = skinning_matrix * res;
-  pret.z *= -1;
-  std::swap(pret.y, pret.z);
-  return pret;
+namespace {
+
+template <typename T> using vec3_t = glm::vec<3, T>;
+template <typename T> using mat3_t = glm::mat<3, 3, T>;
+
+// puma_chain works in render space (y up), IK and FK results are in the
+// z-up space the GUI and solve_task use
+template <typename T> inline vec3_t<T> to_task_space(const vec3_t<T> &v) {
+  return {v.x, -v.z, v.y};
 }
 
-std::vector<internal::puma_state> solve_task(internal::model &model,
-                                             puma_pos settings) {
+// effector position of the chain, shared by forward_kinematics and the
+// reach check of the IK kernel, which has no use for the frame
+template <typename T>
+inline vec3_t<T> effector_position(const internal::basic_puma_state<T> &state) {
+  return to_task_space(kinematics::puma_chain::end_frame<T>(state).t);
+}
+
+// tool axes and wrist target of a pose, shared by every branch
+template <typename T> struct ik_target {
+  vec3_t<T> x5;
+  vec3_t<T> y5;
+  vec3_t<T> z5;
+  vec3_t<T> p5;
+  T a1;
+};
+
+template <typename T>
+inline ik_target<T> make_target(const internal::basic_puma_state<T> &robot,
+                                const basic_puma_pos<T> &settings) {
+  const auto l4 = robot.l4;
+
+  ik_target<T> t;
+  t.x5 = glm::normalize(settings.rot * vec3_t<T>{1, 0, 0});
+  t.y5 = glm::normalize(settings.rot * vec3_t<T>{0, 1, 0});
+  t.z5 = glm::normalize(settings.rot * vec3_t<T>{0, 0, 1});
 
-  // solve the inverse config
-  const static glm::vec3 def_x{1, 0, 0};
-  const static glm::vec3 def_y{0, 1, 0};
-  const static glm::vec3 def_z{0, 0, 1};
-  // 1. solve for start position
-  glm::vec3 start_x5 = glm::normalize(settings.rot * def_x);
-  glm::vec3 start_y5 = glm::normalize(settings.rot * def_y);
-  glm::vec3 start_z5 = glm::normalize(settings.rot * def_z);
+  // nudge the wrist off the base axis, where alpha_1 is undefined
+  t.p5 = settings.pos;
+  const auto wx = t.p5.x - l4 * t.x5.x;
+  const auto wy = t.p5.y - l4 * t.x5.y;
+  const bool on_axis = std::sqrt(wx * wx + wy * wy) < T(0.1);
+  t.p5.x += on_axis ? T(1e-3) : T(0);
+  t.p5.y -= on_axis ? T(1e-3) : T(0);
 
-  auto tmp_p = settings.pos - model.left_puma.l4 * start_x5;
-  tmp_p.z = 0;
-  if (glm::length(tmp_p) < 0.1) {
-      settings.pos.x += 1e-3f;
-      settings.pos.y -= 1e-3f;
+  t.a1 = std::atan((t.p5.y - l4 * t.x5.y) / (t.p5.x - l4 * t.x5.x));
+  return t;
+}
+
+// alpha_4 of the non-flipped wrist for a given alpha_1
+template <typename T> inline T wrist_angle(const ik_target<T> &t, T a1) {
+  auto a = std::asin(std::cos(a1) * t.x5.y - std::sin(a1) * t.x5.x);
+  return a + (std::abs(a) < T(1e-3) ? T(1e-3) : T(0));
+}
+
+template <typename T> inline T flip_wrist(T a4) {
+  constexpr auto pi = glm::pi<T>();
+  return a4 > 0 ? pi - a4 : -pi - a4;
+}
+
+// alpha_5 and the non-flipped alpha_2 for a given alpha_1 and alpha_4
+template <typename T>
+inline void arm_angles(const internal::basic_puma_state<T> &robot,
+                       const ik_target<T> &t, T a1, T a4, T &a2, T &a5) {
+  const auto l1 = robot.l1;
+  const auto l3 = robot.l3;
+  const auto l4 = robot.l4;
+  const auto c1 = std::cos(a1);
+  const auto s1 = std::sin(a1);
+  const auto c4 = std::cos(a4);
+  const auto s4 = std::sin(a4);
+
+  const auto c5 = (c1 * t.y5.y - s1 * t.y5.x) / c4;
+  const auto s5 = (s1 * t.z5.x - c1 * t.z5.y) / c4;
+  a5 = std::atan2(s5, c5);
+
+  const auto nom =
+      -(c1 * c4 * (t.p5.z - l4 * t.x5.z - l1) + l3 * (t.x5.x + s1 * s4));
+  const auto den = c4 * (t.p5.x - l4 * t.x5.x) - c1 * l3 * t.x5.z;
+  a2 = std::atan(nom / den);
+}
+
+// solves the extension and alpha_3 of branch b from its angles and hands
+// the result to write(b, q2, alpha_1, ..., alpha_5, valid)
+template <typename T, typename Sink>
+inline void finish_branch(const internal::basic_puma_state<T> &robot,
+                          const basic_puma_pos<T> &settings,
+                          const ik_target<T> &t, std::size_t b, T a1, T a2,
+                          T a4, T a5, Sink &&write) {
+  constexpr auto pi = glm::pi<T>();
+  const auto l3 = robot.l3;
+  const auto l4 = robot.l4;
+
+  auto anorm = [](T angle) { return std::fmod(angle + 2000 * pi, 2 * pi); };
+  auto wrap = [](T deg) { return deg > T(360) ? deg - T(360) : deg; };
+
+  const auto c1 = std::cos(a1);
+  const auto s1 = std::sin(a1);
+  const auto c2 = std::cos(a2);
+  const auto c4 = std::cos(a4);
+  const auto s4 = std::sin(a4);
+
+  auto q2 = (c4 * (t.p5.x - l4 * t.x5.x) - c1 * l3 * t.x5.z) / (c1 * c2 * c4);
+  const auto c23 = (t.x5.x + s1 * s4) / (c1 * c4);
+  const auto s23 = -t.x5.z / c4;
+  const auto a3 = std::atan2(s23, c23) - a2;
+
+  auto alpha_1 = glm::degrees(anorm(a1));
+  auto alpha_2 = glm::degrees(anorm(a2));
+  auto alpha_3 = glm::degrees(anorm(a3));
+  auto alpha_4 = glm::degrees(anorm(a4));
+  auto alpha_5 = glm::degrees(anorm(a5));
+
+  // negative extension is the same pose with the arm flipped
+  const bool flip = q2 < 0;
+  q2 = flip ? -q2 : q2;
+  alpha_2 = flip ? wrap(alpha_2 + T(180)) : alpha_2;
+  alpha_3 = flip ? wrap(alpha_3 + T(180)) : alpha_3;
+
+  auto sol = robot;
+  sol.q2 = q2;
+  sol.alpha_1 = alpha_1;
+  sol.alpha_2 = alpha_2;
+  sol.alpha_3 = alpha_3;
+  sol.alpha_4 = alpha_4;
+  const auto dist = glm::length(settings.pos - effector_position(sol));
+
+  // written so that a NaN from a degenerate branch counts as invalid
+  write(b, q2, alpha_1, alpha_2, alpha_3, alpha_4, alpha_5,
+        q2 >= 0 && dist <= T(0.5));
+}
+
+// branch-free solve of all 8 candidates of a single pose, branch b uses
+// the shoulder (b & 1), wrist (b & 2) and elbow (b & 4) flip. Every
+// branch is handed to write(b, q2, alpha_1, ..., alpha_5, valid)
+template <typename T, typename Sink>
+inline void solve_branches(const internal::basic_puma_state<T> &robot,
+                           const basic_puma_pos<T> &settings, Sink &&write) {
+  constexpr auto pi = glm::pi<T>();
+  const auto t = make_target(robot, settings);
+
+  T a1[2];
+  a1[0] = t.a1;
+  a1[1] = t.a1 + pi;
+
+  // index = shoulder + 2 * wrist
+  T a4[4];
+  for (int s = 0; s < 2; ++s) {
+    a4[s] = wrist_angle(t, a1[s]);
+    a4[s + 2] = flip_wrist(a4[s]);
   }
 
-  std::vector<internal::puma_state> solutions;
-  solutions.reserve(8);
-  solutions.push_back(model.left_puma);
-  solutions[0].alpha_1 =
-      atan((settings.pos.y - model.left_puma.l4 * start_x5.y) /
-           (settings.pos.x - model.left_puma.l4 * start_x5.x));
-  solutions.push_back(model.left_puma);
-  solutions[1].alpha_1 = solutions[0].alpha_1 + glm::pi<float>();
-  for (int i = 0; i < 2; ++i) {
-    auto &sol = solutions[i];
-    const auto c1 = std::cos(sol.alpha_1);
-    const auto s1 = std::sin(sol.alpha_1);
-
-    sol.alpha_4 = asin(c1 * start_x5.y - s1 * start_x5.x);
-    if (std::abs(sol.alpha_4) < 1e-3) {
-        sol.alpha_4 += 1e-3f;
+  // index = shoulder + 2 * wrist + 4 * elbow
+  T a2[8];
+  T a5[8];
+  for (int k = 0; k < 4; ++k) {
+    arm_angles(robot, t, a1[k & 1], a4[k], a2[k], a5[k]);
+    a2[k + 4] = a2[k] + pi;
+    a5[k + 4] = a5[k];
+  }
+
+  for (std::size_t b = 0; b < basic_ik_solutions<T>::capacity; ++b) {
+    finish_branch(robot, settings, t, b, a1[b & 1], a2[b], a4[b & 3], a5[b],
+                  write);
+  }
+}
+
+// the same as branch b of solve_branches, without solving the other 7.
+// conditioning is |cos(alpha_1) cos(alpha_2) cos(alpha_4)|, the divisor of
+// the extension and wrist terms, near zero the branch is about to swap
+template <typename T, typename Sink>
+inline T solve_single_branch(const internal::basic_puma_state<T> &robot,
+                             const basic_puma_pos<T> &settings, std::size_t b,
+                             Sink &&write) {
+  constexpr auto pi = glm::pi<T>();
+  const auto t = make_target(robot, settings);
+
+  const auto a1 = t.a1 + ((b & 1) ? pi : T(0));
+  auto a4 = wrist_angle(t, a1);
+  a4 = (b & 2) ? flip_wrist(a4) : a4;
+  T a2;
+  T a5;
+  arm_angles(robot, t, a1, a4, a2, a5);
+  a2 += (b & 4) ? pi : T(0);
+
+  finish_branch(robot, settings, t, b, a1, a2, a4, a5, write);
+  return std::abs(std::cos(a1) * std::cos(a2) * std::cos(a4));
+}
+
+// lane math of the batch kernel. Every function is branch free float
+// math on one value, so a loop over poses calling them compiles to SIMD
+// instructions (std::sin and friends are library calls the vectorizer
+// cannot look into). Both sides of a select are computed up front, the
+// compiler does not speculate arithmetic that could trap. Cephes
+// polynomials, within a few ulp over the angles the IK produces, NaN in
+// gives NaN out
+constexpr float lane_pi = glm::pi<float>();
+
+// the lane functions have to end up inside the loop over poses, a call
+// left in it stops the vectorizer, and they are larger than the inliner
+// takes on its own
+#if defined(_MSC_VER)
+#define PUSN_LANE __forceinline
+#else
+#define PUSN_LANE inline __attribute__((always_inline))
+#endif
+
+PUSN_LANE float lane_atan(float x) {
+  // reduced to |r| < tan(pi / 8) around 0, pi / 4 or pi / 2
+  const auto ax = std::abs(x);
+  const bool big = ax > 2.414213562373095f;
+  const bool mid = ax > 0.4142135623730950f;
+  const auto inverse = -1.f / ax;
+  const auto shifted = (ax - 1.f) / (ax + 1.f);
+  const auto r = big ? inverse : (mid ? shifted : ax);
+  const auto base = big ? lane_pi / 2 : (mid ? lane_pi / 4 : 0.f);
+  const auto z = r * r;
+  const auto p = (((8.05374449538e-2f * z - 1.38776856032e-1f) * z +
+                   1.99777106478e-1f) *
+                      z -
+                  3.33329491539e-1f) *
+                     z * r +
+                 r;
+  return std::copysign(base + p, x);
+}
+
+PUSN_LANE float lane_atan2(float y, float x) {
+  // atan covers the right half plane, the left one is half a turn away
+  const auto a = lane_atan(y / x);
+  return a + (x < 0.f ? std::copysign(lane_pi, y) : 0.f);
+}
+
+PUSN_LANE float lane_asin(float x) {
+  // NaN outside [-1, 1] like std::asin
+  return lane_atan2(x, std::sqrt((1.f - x) * (1.f + x)));
+}
+
+PUSN_LANE void lane_sincos(float x, float &s, float &c) {
+  // octant of |x|, lanes out of range (or NaN) are reduced from 0 so the
+  // conversion to int is defined, and made NaN again at the end
+  const auto ax = std::abs(x);
+  const bool in_range = ax < 8192.f;
+  auto j = static_cast<int>((in_range ? ax : 0.f) * 1.27323954473516f);
+  j += j & 1;
+  const auto y = static_cast<float>(j);
+  // pi / 4 in three parts, so r keeps its precision
+  const auto r = ((ax - y * 0.78515625f) - y * 2.4187564849853515625e-4f) -
+                 y * 3.77489497744594108e-8f;
+  const auto z = r * r;
+  const auto sp =
+      ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z - 1.6666654611e-1f) *
+          z * r +
+      r;
+  const auto cp = ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z +
+                   4.166664568298827e-2f) *
+                      z * z -
+                  0.5f * z + 1.f;
+
+  const auto k = (j >> 1) & 3;
+  const auto sa = (k & 1) ? cp : sp;
+  const auto ca = (k & 1) ? sp : cp;
+  const auto sv = (k & 2) ? -sa : sa;
+  const auto cv = ((k + 1) & 2) ? -ca : ca;
+  constexpr auto nan = std::numeric_limits<float>::quiet_NaN();
+  s = in_range ? (x < 0.f ? -sv : sv) : nan;
+  c = in_range ? cv : nan;
+}
+
+// angle in [0, 2 pi) as degrees, for angles within (-3 pi, 4 pi) which is
+// all the IK produces
+PUSN_LANE float lane_degrees(float a) {
+  a += a < 0.f ? 2 * lane_pi : 0.f;
+  a += a < 0.f ? 2 * lane_pi : 0.f;
+  a -= a >= 2 * lane_pi ? 2 * lane_pi : 0.f;
+  a -= a >= 2 * lane_pi ? 2 * lane_pi : 0.f;
+  return a * (180.f / lane_pi);
+}
+
+// poses of one block of the batch, transposed so each lane reads floats
+// from its own column
+struct ik_lanes {
+  static constexpr std::size_t size = 256;
+
+  float px[size];
+  float py[size];
+  float pz[size];
+  float qx[size];
+  float qy[size];
+  float qz[size];
+  float qw[size];
+};
+
+// output columns of a batch, pose 0 of branch b at out[b * stride]
+struct ik_lane_out {
+  float *q2;
+  float *alpha_1;
+  float *alpha_2;
+  float *alpha_3;
+  float *alpha_4;
+  float *alpha_5;
+  std::uint8_t *valid;
+  std::size_t stride;
+};
+
+// tool axes and wrist target of one lane, see ik_target
+struct lane_tool {
+  float x5x;
+  float x5y;
+  float x5z;
+  float y5x;
+  float y5y;
+  float z5x;
+  float z5y;
+  float p5x;
+  float p5z;
+};
+
+// what finish_branch does, on the lane's cosines and sines. The reach
+// check is the puma_chain end position written out: alpha_2 + alpha_3 is
+// the angle of the combined elbow, which does not depend on the branch of
+// alpha_2
+struct ik_lane_arm {
+  float l1;
+  float l3;
+  float l4;
+  float px;
+  float py;
+  float pz;
+};
+
+PUSN_LANE void lane_finish(const ik_lane_out &out, std::size_t index,
+                        const ik_lane_arm &arm, float a1, float c1, float s1,
+                        float a2, float c2, float s2, float a4, float c4,
+                        float s4, float a5, float den, float phi, float c23,
+                        float s23) {
+  const auto q2 = den / (c1 * c2 * c4);
+  const auto a3 = phi - a2;
+
+  auto alpha_2 = lane_degrees(a2);
+  auto alpha_3 = lane_degrees(a3);
+  const bool flip = q2 < 0.f;
+  alpha_2 += flip ? 180.f : 0.f;
+  alpha_3 += flip ? 180.f : 0.f;
+  alpha_2 -= alpha_2 > 360.f ? 360.f : 0.f;
+  alpha_3 -= alpha_3 > 360.f ? 360.f : 0.f;
+
+  // end of the chain in render space (y up), the flip changes the sign of
+  // q2 and of cos(alpha_2) together, so their product is the same
+  const auto q2c2 = q2 * c2;
+  const auto tx = q2c2 * c1 - arm.l3 * s23 * c1 +
+                  arm.l4 * (c4 * c23 * c1 - s4 * s1);
+  const auto ty = arm.l1 - q2 * s2 - arm.l3 * c23 - arm.l4 * c4 * s23;
+  const auto tz = -q2c2 * s1 + arm.l3 * s23 * s1 -
+                  arm.l4 * (c4 * c23 * s1 + s4 * c1);
+  const auto dx = arm.px - tx;
+  const auto dy = arm.py + tz;
+  const auto dz = arm.pz - ty;
+  const auto dist2 = dx * dx + dy * dy + dz * dz;
+
+  const auto q2_out = flip ? -q2 : q2;
+  out.q2[index] = q2_out;
+  out.alpha_1[index] = lane_degrees(a1);
+  out.alpha_2[index] = alpha_2;
+  out.alpha_3[index] = alpha_3;
+  out.alpha_4[index] = lane_degrees(a4);
+  out.alpha_5[index] = lane_degrees(a5);
+  // written so that a NaN from a degenerate branch counts as invalid
+  out.valid[index] =
+      static_cast<std::uint8_t>(q2_out >= 0.f && dist2 <= 0.25f);
+}
+
+// alpha_2, alpha_5 and both elbows of one shoulder and wrist
+PUSN_LANE void lane_arm(const ik_lane_out &out, std::size_t pose,
+                     std::size_t b, const ik_lane_arm &arm, float a1,
+                     float c1, float s1, float a4, float c4, float s4,
+                     const lane_tool &t) {
+  const auto c5 = (c1 * t.y5y - s1 * t.y5x) / c4;
+  const auto s5 = (s1 * t.z5x - c1 * t.z5y) / c4;
+  const auto a5 = lane_atan2(s5, c5);
+
+  const auto nom = -(c1 * c4 * (t.p5z - arm.l4 * t.x5z - arm.l1) +
+                     arm.l3 * (t.x5x + s1 * s4));
+  const auto den = c4 * (t.p5x - arm.l4 * t.x5x) - c1 * arm.l3 * t.x5z;
+  const auto a2 = lane_atan(nom / den);
+  float s2;
+  float c2;
+  lane_sincos(a2, s2, c2);
+
+  // alpha_2 + alpha_3
+  const auto c23 = (t.x5x + s1 * s4) / (c1 * c4);
+  const auto s23 = -t.x5z / c4;
+  const auto phi = lane_atan2(s23, c23);
+  const auto h = 1.f / std::sqrt(c23 * c23 + s23 * s23);
+
+  lane_finish(out, b * out.stride + pose, arm, a1, c1, s1, a2, c2, s2, a4,
+              c4, s4, a5, den, phi, c23 * h, s23 * h);
+  lane_finish(out, (b + 4) * out.stride + pose, arm, a1, c1, s1,
+              a2 + lane_pi, -c2, -s2, a4, c4, s4, a5, den, phi, c23 * h,
+              s23 * h);
+}
+
+// wrist angles of one shoulder, the flipped wrist comes from the same sine
+// and cosine
+PUSN_LANE void lane_shoulder(const ik_lane_out &out, std::size_t pose,
+                          std::size_t shoulder, const ik_lane_arm &arm,
+                          const lane_tool &t, float a1, float c1, float s1) {
+  const auto raw = lane_asin(c1 * t.x5y - s1 * t.x5x);
+  const auto a4 = raw + (std::abs(raw) < 1e-3f ? 1e-3f : 0.f);
+  float s4;
+  float c4;
+  lane_sincos(a4, s4, c4);
+  const auto up = lane_pi - a4;
+  const auto down = -lane_pi - a4;
+  const auto a4_flipped = a4 > 0.f ? up : down;
+
+  lane_arm(out, pose, shoulder, arm, a1, c1, s1, a4, c4, s4, t);
+  lane_arm(out, pose, shoulder + 2, arm, a1, c1, s1, a4_flipped, -c4, s4, t);
+}
+
+// solve_branches for one lane, the flipped shoulder is half a turn away
+// and uses the same sine and cosine with their signs changed
+PUSN_LANE void lane_solve(const ik_lane_out &out, std::size_t pose,
+                       const internal::puma_state &robot, float px, float py,
+                       float pz, float ux, float uy, float uz, float w) {
+  const auto l4 = robot.l4;
+
+  // the tool axes as glm rotates them by the quaternion, normalized
+  const auto uu = ux * ux + uy * uy + uz * uz;
+  auto x5x = 1.f + 2.f * (ux * ux - uu);
+  auto x5y = 2.f * (w * uz + ux * uy);
+  auto x5z = 2.f * (ux * uz - w * uy);
+  auto y5x = 2.f * (ux * uy - w * uz);
+  auto y5y = 1.f + 2.f * (uy * uy - uu);
+  auto z5x = 2.f * (w * uy + ux * uz);
+  auto z5y = 2.f * (uy * uz - w * ux);
+  const auto y5z = 2.f * (w * ux + uy * uz);
+  const auto z5z = 1.f + 2.f * (uz * uz - uu);
+  const auto nx = 1.f / std::sqrt(x5x * x5x + x5y * x5y + x5z * x5z);
+  const auto ny = 1.f / std::sqrt(y5x * y5x + y5y * y5y + y5z * y5z);
+  const auto nz = 1.f / std::sqrt(z5x * z5x + z5y * z5y + z5z * z5z);
+  x5x *= nx;
+  x5y *= nx;
+  x5z *= nx;
+  y5x *= ny;
+  y5y *= ny;
+  z5x *= nz;
+  z5y *= nz;
+
+  // nudge the wrist off the base axis, where alpha_1 is undefined
+  const auto wx = px - l4 * x5x;
+  const auto wy = py - l4 * x5y;
+  const bool on_axis = std::sqrt(wx * wx + wy * wy) < 0.1f;
+  const auto p5x = px + (on_axis ? 1e-3f : 0.f);
+  const auto p5y = py - (on_axis ? 1e-3f : 0.f);
+
+  const auto a1 = lane_atan((p5y - l4 * x5y) / (p5x - l4 * x5x));
+  float s1;
+  float c1;
+  lane_sincos(a1, s1, c1);
+
+  const ik_lane_arm arm{robot.l1, robot.l3, l4, px, py, pz};
+  const lane_tool tool{x5x, x5y, x5z, y5x, y5y, z5x, z5y, p5x, pz};
+  lane_shoulder(out, pose, 0, arm, tool, a1, c1, s1);
+  lane_shoulder(out, pose, 1, arm, tool, a1 + lane_pi, -c1, -s1);
+}
+
+template <typename T>
+using puma_vector = std::array<T, kinematics::puma_chain::dof>;
+
+// position error and small-angle orientation error that rotates the
+// current frame onto the target frame
+template <typename T> struct pose_error {
+  vec3_t<T> linear;
+  vec3_t<T> angular;
+
+  inline T position() const { return glm::length(linear); }
+  inline T orientation() const { return glm::length(angular); }
+  inline T squared() const {
+    return glm::dot(linear, linear) + glm::dot(angular, angular);
+  }
+};
+
+template <typename T>
+inline pose_error<T> error_to(const basic_effector_pose<T> &current,
+                              const mat3_t<T> &target_frame,
+                              const vec3_t<T> &target_pos) {
+  return {target_pos - current.pos,
+          T(0.5) * (glm::cross(current.frame[0], target_frame[0]) +
+                    glm::cross(current.frame[1], target_frame[1]) +
+                    glm::cross(current.frame[2], target_frame[2]))};
+}
+
+template <typename T, std::size_t... I>
+inline void apply_step(internal::basic_puma_state<T> &state,
+                       const puma_vector<T> &step, std::index_sequence<I...>) {
+  constexpr auto vars = kinematics::puma_chain::variables();
+  ((kinematics::value<vars[I]>(state) += step[I]), ...);
+}
+
+// solves (J^T J + lambda diag(J^T J)) step = J^T e by Cholesky, the system
+// is symmetric positive definite as long as the damping is positive
+template <typename T>
+inline puma_vector<T> damped_step(const basic_puma_jacobian<T> &j,
+                                  const pose_error<T> &e, T damping) {
+  constexpr auto n = kinematics::puma_chain::dof;
+
+  std::array<puma_vector<T>, n> a;
+  puma_vector<T> rhs;
+  for (std::size_t r = 0; r < n; ++r) {
+    for (std::size_t c = 0; c <= r; ++c) {
+      a[r][c] = glm::dot(j.linear[r], j.linear[c]) +
+                glm::dot(j.angular[r], j.angular[c]);
     }
+    a[r][r] += damping * a[r][r] + T(1e-12);
+    rhs[r] = glm::dot(j.linear[r], e.linear) + glm::dot(j.angular[r], e.angular);
+  }
 
-    auto copied = sol;
-    copied.alpha_4 = sol.alpha_4 > 0 ? glm::pi<float>() - sol.alpha_4
-                                     : -glm::pi<float>() - sol.alpha_4;
-    solutions.push_back(copied);
+  // in place lower triangular factor
+  for (std::size_t c = 0; c < n; ++c) {
+    auto d = a[c][c];
+    for (std::size_t k = 0; k < c; ++k) {
+      d -= a[c][k] * a[c][k];
+    }
+    a[c][c] = std::sqrt(std::max(d, T(1e-20)));
+    for (std::size_t r = c + 1; r < n; ++r) {
+      auto v = a[r][c];
+      for (std::size_t k = 0; k < c; ++k) {
+        v -= a[r][k] * a[c][k];
+      }
+      a[r][c] = v / a[c][c];
+    }
   }
 
-  for (int i = 0; i < 4; ++i) {
-    auto &sol = solutions[i];
-    auto &x5 = start_x5;
-    auto &p5 = settings.pos;
-    const auto c1 = std::cos(sol.alpha_1);
-    const auto s1 = std::sin(sol.alpha_1);
-    const auto c4 = std::cos(sol.alpha_4);
-    const auto s4 = std::sin(sol.alpha_4);
+  puma_vector<T> x;
+  for (std::size_t r = 0; r < n; ++r) {
+    auto v = rhs[r];
+    for (std::size_t k = 0; k < r; ++k) {
+      v -= a[r][k] * x[k];
+    }
+    x[r] = v / a[r][r];
+  }
+  for (std::size_t r = n; r-- > 0;) {
+    auto v = x[r];
+    for (std::size_t k = r + 1; k < n; ++k) {
+      v -= a[k][r] * x[k];
+    }
+    x[r] = v / a[r][r];
+  }
+  return x;
+}
 
-    const auto c5 = (c1 * start_y5.y - s1 * start_y5.x) / c4;
-    const auto s5 = (s1 * start_z5.x - c1 * start_z5.y) / c4;
+} // namespace
 
-    sol.alpha_5 = atan2(s5, c5);
+template <typename T>
+vec3_t<T> get_actuator_pos(const internal::basic_puma_state<T> &state) {
+  return effector_position(state);
+}
 
-    const auto nom = -(c1 * c4 * (p5.z - sol.l4 * x5.z - sol.l1) +
-                       sol.l3 * (x5.x + s1 * s4));
-    const auto den = c4 * (p5.x - sol.l4 * x5.x) - c1 * sol.l3 * x5.z;
-    sol.alpha_2 = atan(nom / den);
-    auto copied = sol;
-    copied.alpha_2 = sol.alpha_2 + glm::pi<float>();
-    solutions.push_back(copied);
+template <typename T>
+basic_effector_pose<T>
+forward_kinematics(const internal::basic_puma_state<T> &state) {
+  const auto f = kinematics::puma_chain::end_frame<T>(state);
+  // the frame is conjugated by the same change of basis as the position
+  return {to_task_space(f.t),
+          mat3_t<T>(to_task_space(f.r[0]), -to_task_space(f.r[2]),
+                    to_task_space(f.r[1]))};
+}
+
+template <typename T>
+basic_puma_jacobian<T> jacobian(const internal::basic_puma_state<T> &state) {
+  auto ret = kinematics::puma_chain::jacobian_of<T>(state);
+  for (std::size_t i = 0; i < kinematics::puma_chain::dof; ++i) {
+    ret.linear[i] = to_task_space(ret.linear[i]);
+    ret.angular[i] = to_task_space(ret.angular[i]);
+  }
+  return ret;
+}
+
+void forward_kinematics_batch(std::span<const internal::puma_state> states,
+                              std::span<effector_pose> out) {
+  const auto count =
+      static_cast<std::int64_t>(std::min(states.size(), out.size()));
+#ifdef _OPENMP
+#pragma omp parallel for simd schedule(static)
+#endif
+  for (std::int64_t i = 0; i < count; ++i) {
+    out[i] = forward_kinematics(states[i]);
+  }
+}
+
+template <typename T>
+std::size_t
+basic_ik_solutions<T>::closest(const internal::basic_puma_state<T> &to) const {
+  std::size_t ret = capacity;
+  T closest_dist = std::numeric_limits<T>::max();
+  for (std::size_t i = 0; i < capacity; ++i) {
+    if (!is_valid(i)) {
+      continue;
+    }
+    const auto dist = internal::state_dist(to, states[i]);
+    if (dist < closest_dist) {
+      closest_dist = dist;
+      ret = i;
+    }
   }
+  return ret;
+}
 
-  for (int i = 0; i < 8; ++i) {
-    auto &sol = solutions[i];
-    auto &x5 = start_x5;
-    auto &p5 = settings.pos;
-    const auto c1 = std::cos(sol.alpha_1);
-    const auto s1 = std::sin(sol.alpha_1);
-    const auto c2 = std::cos(sol.alpha_2);
-    const auto c4 = std::cos(sol.alpha_4);
-    const auto s4 = std::sin(sol.alpha_4);
+template <typename T>
+basic_ik_solutions<T> solve_task(const internal::basic_puma_state<T> &robot,
+                                 const basic_puma_pos<T> &settings) {
+  basic_ik_solutions<T> ret;
+  solve_branches(robot, settings,
+                 [&](std::size_t b, T q2, T alpha_1, T alpha_2, T alpha_3,
+                     T alpha_4, T alpha_5, bool valid) {
+                   auto &sol = ret.states[b];
+                   sol = robot;
+                   sol.q2 = q2;
+                   sol.alpha_1 = alpha_1;
+                   sol.alpha_2 = alpha_2;
+                   sol.alpha_3 = alpha_3;
+                   sol.alpha_4 = alpha_4;
+                   sol.alpha_5 = alpha_5;
+                   ret.valid_mask |= valid << b;
+                 });
+  return ret;
+}
+
+std::vector<internal::puma_state> solve_task(internal::model &model,
+                                             puma_pos settings) {
+  const auto fixed = solve_task(model.left_puma, settings);
+
+  std::vector<internal::puma_state> solutions;
+  solutions.reserve(fixed.size());
+  for (std::size_t i = 0; i < ik_solutions::capacity; ++i) {
+    if (fixed.is_valid(i)) {
+      solutions.push_back(fixed.states[i]);
+    }
+  }
+  return solutions;
+}
 
-    sol.q2 =
-        (c4 * (p5.x - sol.l4 * x5.x) - c1 * sol.l3 * x5.z) / (c1 * c2 * c4);
+bool solve_task_tracked(const internal::puma_state &robot,
+                        const puma_pos &settings,
+                        internal::ik_tracking &tracking,
+                        internal::puma_state &current) {
+  if (tracking.branch != internal::ik_tracking::no_branch) {
+    auto candidate = robot;
+    bool valid = false;
+    const auto conditioning = solve_single_branch(
+        robot, settings, tracking.branch,
+        [&](std::size_t, float q2, float alpha_1, float alpha_2, float alpha_3,
+            float alpha_4, float alpha_5, bool branch_valid) {
+          candidate.q2 = q2;
+          candidate.alpha_1 = alpha_1;
+          candidate.alpha_2 = alpha_2;
+          candidate.alpha_3 = alpha_3;
+          candidate.alpha_4 = alpha_4;
+          candidate.alpha_5 = alpha_5;
+          valid = branch_valid;
+        });
 
-    const auto c23 = (x5.x + s1 * s4) / (c1 * c4);
-    const auto s23 = -x5.z / c4;
+    if (valid && conditioning > tracking.min_conditioning &&
+        internal::state_dist(candidate, current) < tracking.max_step) {
+      current = candidate;
+      ++tracking.tracked_steps;
+      return true;
+    }
+  }
 
-    const auto a23 = atan2(s23, c23);
-    sol.alpha_3 = a23 - sol.alpha_2;
+  // no branch yet, or it is leaving its domain - pick the nearest of all 8
+  ++tracking.full_solves;
+  const auto solutions = solve_task(robot, settings);
+  const auto closest = solutions.closest(current);
+  if (closest == ik_solutions::capacity) {
+    tracking.reset();
+    return false;
   }
+  tracking.branch = static_cast<std::uint8_t>(closest);
+  current = solutions.states[closest];
+  return true;
+}
+
+template <typename T>
+basic_ik_residual<T> refine_task(internal::basic_puma_state<T> &state,
+                                 const basic_puma_pos<T> &target,
+                                 const basic_ik_refine_settings<T> &settings) {
+  const auto target_frame = glm::mat3_cast(glm::normalize(target.rot));
+  auto err = error_to(forward_kinematics(state), target_frame, target.pos);
 
-  auto anorm = [](float angle) {
-    return fmod(angle + 2000 * glm::pi<float>(), 2 * glm::pi<float>());
+  basic_ik_residual<T> ret;
+  auto converged = [&]() {
+    return err.position() < settings.tolerance &&
+           err.orientation() < settings.tolerance;
   };
 
-  for (auto &sol : solutions) {
-    sol.alpha_1 = glm::degrees(anorm(sol.alpha_1));
-    sol.alpha_2 = glm::degrees(anorm(sol.alpha_2));
-    sol.alpha_3 = glm::degrees(anorm(sol.alpha_3));
-    sol.alpha_4 = glm::degrees(anorm(sol.alpha_4));
-    sol.alpha_5 = glm::degrees(anorm(sol.alpha_5));
-
-    if (sol.q2 < 0) {
-      sol.q2 *= -1;
-      sol.alpha_2 += 180;
-      if (sol.alpha_2 > 360) {
-        sol.alpha_2 -= 360;
-      }
-      sol.alpha_3 += 180;
-      if (sol.alpha_3 > 360) {
-        sol.alpha_3 -= 360;
-      }
+  auto damping = settings.damping;
+  while (ret.iterations < settings.max_iterations && !converged()) {
+    ++ret.iterations;
+    const auto step = damped_step(jacobian(state), err, damping);
+
+    auto next = state;
+    apply_step(next, step,
+               std::make_index_sequence<kinematics::puma_chain::dof>{});
+    const auto next_err =
+        error_to(forward_kinematics(next), target_frame, target.pos);
+
+    // a step that overshoots is rejected and retried with more damping
+    if (next_err.squared() < err.squared()) {
+      state = next;
+      err = next_err;
+      damping *= T(0.1);
+    } else {
+      damping *= T(10);
     }
   }
 
-  std::erase_if(solutions, [&](const auto &sol) {
-    const auto lpos = get_actuator_pos(sol);
-    const auto p5 = settings.pos;
-    //LOGGER_INFO("Actuator: {0}, {1}, {2}", lpos.x, lpos.y, lpos.z);
-    //LOGGER_INFO("Actuator: {0}, {1}, {2}", p5.x, p5.y, p5.z);
+  ret.position = err.position();
+  ret.orientation = err.orientation();
+  return ret;
+}
 
-    const auto dist = glm::length(settings.pos - lpos);
-    return (sol.q2 < 0) || (dist > 0.5f);
-  });
+// float drives rendering and the animation, double is there for offline
+// planning where accuracy matters more than throughput
+#define PUSN_INSTANTIATE_KINEMATICS(T)                                         \
+  template vec3_t<T> get_actuator_pos(const internal::basic_puma_state<T> &);  \
+  template basic_effector_pose<T> forward_kinematics(                         \
+      const internal::basic_puma_state<T> &);                                  \
+  template basic_puma_jacobian<T> jacobian(                                    \
+      const internal::basic_puma_state<T> &);                                  \
+  template struct basic_ik_solutions<T>;                                       \
+  template basic_ik_solutions<T> solve_task(                                   \
+      const internal::basic_puma_state<T> &, const basic_puma_pos<T> &);       \
+  template basic_ik_residual<T> refine_task(                                   \
+      internal::basic_puma_state<T> &, const basic_puma_pos<T> &,              \
+      const basic_ik_refine_settings<T> &);
 
-  return solutions;
+PUSN_INSTANTIATE_KINEMATICS(float)
+PUSN_INSTANTIATE_KINEMATICS(double)
+
+#undef PUSN_INSTANTIATE_KINEMATICS
+
+void ik_batch_solutions::resize(std::size_t pose_count) {
+  count = pose_count;
+  const auto n = branch_count * pose_count;
+  q2.resize(n);
+  alpha_1.resize(n);
+  alpha_2.resize(n);
+  alpha_3.resize(n);
+  alpha_4.resize(n);
+  alpha_5.resize(n);
+  valid.resize(n);
+}
+
+internal::puma_state ik_batch_solutions::get(const internal::puma_state &robot,
+                                             std::size_t branch,
+                                             std::size_t pose) const {
+  const auto i = index(branch, pose);
+  auto ret = robot;
+  ret.q2 = q2[i];
+  ret.alpha_1 = alpha_1[i];
+  ret.alpha_2 = alpha_2[i];
+  ret.alpha_3 = alpha_3[i];
+  ret.alpha_4 = alpha_4[i];
+  ret.alpha_5 = alpha_5[i];
+  return ret;
 }
+
+void solve_task_batch(const internal::puma_state &robot,
+                      std::span<const puma_pos> poses,
+                      ik_batch_solutions &out) {
+  out.resize(poses.size());
+  const auto blocks =
+      static_cast<std::int64_t>((poses.size() + ik_lanes::size - 1) /
+                                ik_lanes::size);
+
+  // blocks of poses are split across cores, each one is transposed into
+  // columns and solved ik_lanes::size poses at a time in SIMD lanes
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for (std::int64_t block = 0; block < blocks; ++block) {
+    const auto first = static_cast<std::size_t>(block) * ik_lanes::size;
+    const auto n = std::min(ik_lanes::size, poses.size() - first);
+
+    ik_lanes in;
+    for (std::size_t i = 0; i < n; ++i) {
+      const auto &p = poses[first + i];
+      in.px[i] = p.pos.x;
+      in.py[i] = p.pos.y;
+      in.pz[i] = p.pos.z;
+      in.qx[i] = p.rot.x;
+      in.qy[i] = p.rot.y;
+      in.qz[i] = p.rot.z;
+      in.qw[i] = p.rot.w;
+    }
+
+    const ik_lane_out columns{out.q2.data() + first,
+                              out.alpha_1.data() + first,
+                              out.alpha_2.data() + first,
+                              out.alpha_3.data() + first,
+                              out.alpha_4.data() + first,
+                              out.alpha_5.data() + first,
+                              out.valid.data() + first,
+                              out.count};
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for (std::size_t i = 0; i < n; ++i) {
+      lane_solve(columns, i, robot, in.px[i], in.py[i], in.pz[i], in.qx[i],
+                 in.qy[i], in.qz[i], in.qw[i]);
+    }
+  }
+}
+
+#undef PUSN_LANE
 } // namespace pusn
@@ -0,0 +1,163 @@
+#include <motion_program.hpp>
+
+#include <algorithm>
+#include <chrono>
+
+#include <inverse_kinematics.hpp>
+#include <trajectory.hpp>
+
+namespace pusn {
+
+std::uint8_t solve_waypoint(ik_cache &cache,
+                            const internal::puma_state &robot,
+                            const internal::waypoint &w,
+                            const internal::puma_state &near,
+                            internal::puma_state &out) {
+  const auto &solutions = cache.solve(robot, {w.position, w.rotation});
+  const auto closest = solutions.closest(near);
+  if (closest == solutions.capacity) {
+    out = near;
+    return internal::ik_tracking::no_branch;
+  }
+  out = solutions.states[closest];
+  return static_cast<std::uint8_t>(closest);
+}
+
+program_runner::program_runner(waypoint_source source,
+                               const internal::puma_state &robot,
+                               const internal::simulation_settings &defaults,
+                               float bake_step)
+    : source(std::move(source)), robot(robot), defaults(defaults),
+      bake_step(bake_step) {}
+
+namespace {
+
+// plays waypoints back in order. The joints and branches solved for them
+// are only kept when there is one of each per waypoint, the program is
+// solved again otherwise
+waypoint_source memory_source(std::vector<internal::waypoint> waypoints,
+                              std::vector<internal::puma_state> &states,
+                              std::vector<std::uint8_t> &branches) {
+  if (states.size() != waypoints.size() ||
+      branches.size() != waypoints.size()) {
+    states.clear();
+    branches.clear();
+  }
+  return [waypoints = std::move(waypoints),
+          i = std::size_t{0}](internal::waypoint &out) mutable {
+    if (i == waypoints.size()) {
+      return false;
+    }
+    out = waypoints[i++];
+    return true;
+  };
+}
+
+} // namespace
+
+program_runner::program_runner(std::vector<internal::waypoint> waypoints,
+                               const internal::puma_state &robot,
+                               const internal::simulation_settings &defaults,
+                               std::vector<internal::puma_state> states,
+                               std::vector<std::uint8_t> branches,
+                               float bake_step)
+    : source(memory_source(std::move(waypoints), states, branches)),
+      states(std::move(states)), branches(std::move(branches)),
+      robot(robot), defaults(defaults), bake_step(bake_step) {}
+
+program_runner::~program_runner() { stop(); }
+
+void program_runner::start() {
+  if (worker.joinable()) {
+    return;
+  }
+  stop_requested.store(false, std::memory_order_relaxed);
+  worker = std::thread([this]() { run(); });
+}
+
+void program_runner::stop() {
+  stop_requested.store(true, std::memory_order_relaxed);
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+bool program_runner::next(prepared_segment &out) {
+  if (!segments.pop(out)) {
+    return false;
+  }
+  waiting = false;
+  handed_out.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void program_runner::run() {
+  // joints at waypoint i, continuing from near. states and branches are
+  // either empty or cover the whole program (see memory_source)
+  const bool solved = !states.empty();
+  auto solve = [&](std::size_t i, const internal::waypoint &w,
+                   const internal::puma_state &near) {
+    if (solved) {
+      if (branches[i] == internal::ik_tracking::no_branch) {
+        unreachable.fetch_add(1, std::memory_order_relaxed);
+      }
+      return states[i];
+    }
+    internal::puma_state ret;
+    if (solve_waypoint(cache, robot, w, near, ret) ==
+        internal::ik_tracking::no_branch) {
+      unreachable.fetch_add(1, std::memory_order_relaxed);
+    }
+    return ret;
+  };
+
+  internal::waypoint from;
+  internal::waypoint to;
+  if (!source(from)) {
+    exhausted.store(true, std::memory_order_release);
+    return;
+  }
+  std::size_t read = 1;
+  waypoints_read.store(read, std::memory_order_relaxed);
+
+  auto start_state = solve(0, from, robot);
+  auto right_puma = start_state;
+
+  for (std::size_t i = 0; source(to); ++i) {
+    waypoints_read.store(++read, std::memory_order_relaxed);
+
+    prepared_segment segment{i, defaults, {}};
+    auto &settings = segment.settings;
+    settings.length = std::max(to.duration, bake_step);
+    settings.position_start = from.position;
+    settings.position_end = to.position;
+    settings.quat_rotation_start = from.rotation;
+    settings.quat_rotation_end = to.rotation;
+    settings.start_state = start_state;
+    settings.end_state = solve(i + 1, to, start_state);
+
+    auto trajectory =
+        std::make_shared<baked_trajectory>(settings.length, bake_step);
+    // stop() does not wait for the rest of a long segment
+    bake_trajectory(*trajectory, settings, start_state, right_puma,
+                    &stop_requested);
+    if (stop_requested.load(std::memory_order_relaxed)) {
+      return;
+    }
+    right_puma = trajectory->samples.back().right_puma;
+    start_state = settings.end_state;
+    from = to;
+    segment.trajectory = std::move(trajectory);
+
+    while (!segments.push(segment)) {
+      if (stop_requested.load(std::memory_order_relaxed)) {
+        return;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    prepared.fetch_add(1, std::memory_order_relaxed);
+  }
+  exhausted.store(true, std::memory_order_release);
+}
+
+} // namespace pusn
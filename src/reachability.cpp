@@ -0,0 +1,258 @@
+#include <reachability.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+namespace pusn {
+
+static_assert(std::endian::native == std::endian::little,
+              "reachability files are little endian and used as mapped");
+
+namespace {
+// a bounds axis lookups can divide by
+bool valid_extent(float min, float max) {
+  return std::isfinite(min) && std::isfinite(max) && max > min;
+}
+} // namespace
+
+std::vector<glm::quat> cube_orientations() {
+  // every signed permutation matrix with determinant 1
+  std::vector<glm::quat> ret;
+  const int perms[6][3] = {{0, 1, 2}, {0, 2, 1}, {1, 0, 2},
+                           {1, 2, 0}, {2, 0, 1}, {2, 1, 0}};
+  for (const auto &p : perms) {
+    for (int signs = 0; signs < 8; ++signs) {
+      glm::mat3 m(0.f);
+      for (int c = 0; c < 3; ++c) {
+        m[c][p[c]] = (signs >> c) & 1 ? -1.f : 1.f;
+      }
+      if (glm::determinant(m) > 0.f) {
+        ret.push_back(glm::quat_cast(m));
+      }
+    }
+  }
+  return ret;
+}
+
+reachability_volume::~reachability_volume() { release(); }
+
+reachability_volume::reachability_volume(reachability_volume &&other) noexcept
+    : storage(std::move(other.storage)), file(std::move(other.file)),
+      bytes(other.bytes), counts(other.counts),
+      rotations(std::move(other.rotations)) {
+  other.bytes = nullptr;
+  other.counts = nullptr;
+}
+
+reachability_volume &
+reachability_volume::operator=(reachability_volume &&other) noexcept {
+  if (this != &other) {
+    release();
+    storage = std::move(other.storage);
+    file = std::move(other.file);
+    bytes = other.bytes;
+    counts = other.counts;
+    rotations = std::move(other.rotations);
+    other.bytes = nullptr;
+    other.counts = nullptr;
+  }
+  return *this;
+}
+
+void reachability_volume::release() {
+  storage.clear();
+  file = {};
+  bytes = nullptr;
+  counts = nullptr;
+  rotations.clear();
+}
+
+std::size_t reachability_volume::data_offset(std::size_t orientation_count) {
+  return sizeof(reachability_header) + orientation_count * 4 * sizeof(float);
+}
+
+void reachability_volume::read_orientations() {
+  const auto &h = header();
+  rotations.resize(h.orientation_count);
+  const auto *q = bytes + sizeof(reachability_header);
+  for (auto &r : rotations) {
+    float xyzw[4];
+    std::memcpy(xyzw, q, sizeof(xyzw));
+    r = glm::quat(xyzw[3], xyzw[0], xyzw[1], xyzw[2]);
+    q += sizeof(xyzw);
+  }
+  counts = bytes + data_offset(h.orientation_count);
+}
+
+reachability_volume
+reachability_volume::compute(const internal::puma_state &robot,
+                             const glm::vec3 &min, const glm::vec3 &max,
+                             const glm::ivec3 &resolution,
+                             std::span<const glm::quat> orientations) {
+  reachability_header h{};
+  std::memcpy(h.magic, magic, sizeof(magic));
+  h.version = version;
+  h.orientation_count = static_cast<std::uint32_t>(orientations.size());
+  for (int i = 0; i < 3; ++i) {
+    h.resolution[i] = std::max(resolution[i], 1);
+    h.min[i] = min[i];
+    // an empty axis becomes the thinnest slab above min
+    h.max[i] = valid_extent(min[i], max[i])
+                   ? max[i]
+                   : std::nextafter(min[i],
+                                    std::numeric_limits<float>::infinity());
+  }
+  h.links[0] = robot.l1;
+  h.links[1] = robot.l3;
+  h.links[2] = robot.l4;
+
+  const auto cells = static_cast<std::size_t>(h.resolution[0]) *
+                     h.resolution[1] * h.resolution[2];
+  const auto offset = data_offset(orientations.size());
+
+  reachability_volume ret;
+  ret.storage.resize(offset + cells * orientations.size());
+  std::memcpy(ret.storage.data(), &h, sizeof(h));
+  auto *q = ret.storage.data() + sizeof(h);
+  for (const auto &r : orientations) {
+    const float xyzw[4] = {r.x, r.y, r.z, r.w};
+    std::memcpy(q, xyzw, sizeof(xyzw));
+    q += sizeof(xyzw);
+  }
+
+  auto *data = ret.storage.data() + offset;
+  const glm::vec3 lo{h.min[0], h.min[1], h.min[2]};
+  const glm::vec3 hi{h.max[0], h.max[1], h.max[2]};
+  const glm::vec3 cell_size = (hi - lo) / glm::vec3(h.resolution[0],
+                                                      h.resolution[1],
+                                                      h.resolution[2]);
+  const auto count = static_cast<std::int64_t>(cells);
+
+  // every cell writes its own bytes, dynamic scheduling because cells far
+  // from the arm fail early and are much cheaper than reachable ones
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 64)
+#endif
+  for (std::int64_t c = 0; c < count; ++c) {
+    const auto x = c % h.resolution[0];
+    const auto y = (c / h.resolution[0]) % h.resolution[1];
+    const auto z = c / (static_cast<std::int64_t>(h.resolution[0]) *
+                        h.resolution[1]);
+    const glm::vec3 center =
+        lo + cell_size * glm::vec3(x + 0.5f, y + 0.5f, z + 0.5f);
+
+    for (std::size_t o = 0; o < orientations.size(); ++o) {
+      data[c * orientations.size() + o] = static_cast<std::uint8_t>(
+          solve_task(robot, {center, orientations[o]}).size());
+    }
+  }
+
+  ret.bytes = ret.storage.data();
+  ret.read_orientations();
+  return ret;
+}
+
+bool reachability_volume::save(const std::filesystem::path &path) const {
+  if (empty()) {
+    return false;
+  }
+  std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+  const auto &h = header();
+  const auto size = data_offset(h.orientation_count) +
+                    static_cast<std::size_t>(h.resolution[0]) *
+                        h.resolution[1] * h.resolution[2] *
+                        h.orientation_count;
+  ofs.write(reinterpret_cast<const char *>(bytes),
+            static_cast<std::streamsize>(size));
+  return static_cast<bool>(ofs);
+}
+
+std::optional<reachability_volume>
+reachability_volume::load(const std::filesystem::path &path) {
+  reachability_volume ret;
+  std::size_t size = 0;
+
+  ret.file = utils::mapped_file(path);
+  if (!ret.file.is_open() || ret.file.size() == 0) {
+    return std::nullopt;
+  }
+  size = ret.file.size();
+  ret.bytes = ret.file.bytes().data();
+
+  if (size < sizeof(reachability_header)) {
+    return std::nullopt;
+  }
+  const auto &h = ret.header();
+  if (std::memcmp(h.magic, magic, sizeof(magic)) != 0 ||
+      h.version != version || h.resolution[0] < 1 || h.resolution[1] < 1 ||
+      h.resolution[2] < 1) {
+    return std::nullopt;
+  }
+  for (int i = 0; i < 3; ++i) {
+    if (!valid_extent(h.min[i], h.max[i])) {
+      return std::nullopt;
+    }
+  }
+  const auto expected = data_offset(h.orientation_count) +
+                        static_cast<std::size_t>(h.resolution[0]) *
+                            h.resolution[1] * h.resolution[2] *
+                            h.orientation_count;
+  if (size != expected) {
+    return std::nullopt;
+  }
+
+  ret.read_orientations();
+  return ret;
+}
+
+bool reachability_volume::matches(const internal::puma_state &robot) const {
+  if (empty()) {
+    return false;
+  }
+  const auto &h = header();
+  return h.links[0] == robot.l1 && h.links[1] == robot.l3 &&
+         h.links[2] == robot.l4;
+}
+
+std::size_t reachability_volume::nearest_orientation(const glm::quat &rot) const {
+  std::size_t ret = 0;
+  float best = -1.f;
+  for (std::size_t i = 0; i < rotations.size(); ++i) {
+    // |dot| so q and -q count as the same orientation
+    const auto d = std::abs(glm::dot(rotations[i], rot));
+    if (d > best) {
+      best = d;
+      ret = i;
+    }
+  }
+  return ret;
+}
+
+std::uint8_t reachability_volume::branch_count(const glm::vec3 &pos,
+                                               std::size_t orientation) const {
+  const auto &h = header();
+  if (orientation >= h.orientation_count) {
+    return 0;
+  }
+  int cell[3];
+  for (int i = 0; i < 3; ++i) {
+    const auto t = (pos[i] - h.min[i]) / (h.max[i] - h.min[i]);
+    // outside the volume (or NaN), before anything is cast to int
+    if (!(t >= 0.f && t < 1.f)) {
+      return 0;
+    }
+    cell[i] = std::min(static_cast<int>(t * h.resolution[i]),
+                       h.resolution[i] - 1);
+  }
+  const auto index =
+      (static_cast<std::size_t>(cell[2]) * h.resolution[1] + cell[1]) *
+          h.resolution[0] +
+      cell[0];
+  return counts[index * h.orientation_count + orientation];
+}
+
+} // namespace pusn
@@ -0,0 +1,204 @@
+#include <simulation.hpp>
+
+#include <algorithm>
+
+#include <inverse_kinematics.hpp>
+#include <motion_program.hpp>
+#include <trajectory.hpp>
+
+namespace pusn {
+
+void animate(internal::motion_state &model,
+             std::chrono::system_clock::time_point time) {
+  if (!model.current_settings.has_value()) {
+    return;
+  }
+
+  auto &settings = model.current_settings.value();
+  std::chrono::duration<float> elapsed_seconds = time - settings.start_time;
+  float progress = elapsed_seconds.count() / settings.length;
+
+  // a program goes on with its next segment from where the last one ended
+  const auto segment_end = [&]() {
+    return settings.start_time +
+           std::chrono::duration_cast<std::chrono::system_clock::duration>(
+               std::chrono::duration<float>(settings.length));
+  };
+  prepared_segment next;
+  while (progress > 1.0 && model.program && model.program->next(next)) {
+    const auto start_time = segment_end();
+    settings = next.settings;
+    settings.start_time = start_time;
+    model.trajectory = std::move(next.trajectory);
+    elapsed_seconds = time - settings.start_time;
+    progress = elapsed_seconds.count() / settings.length;
+  }
+
+  if (progress > 1.0) {
+    // the next segment is not prepared yet, the robot waits at the end of
+    // this one and the program resumes from the time it shows up
+    if (model.program && !model.program->done()) {
+      model.program->note_underrun();
+      settings.start_time = time - (segment_end() - settings.start_time);
+      return;
+    }
+    model.current_settings.reset();
+    model.trajectory.reset();
+    model.program.reset();
+    model.right_puma_tracking.reset();
+    return;
+  }
+
+  // parts of the move that are not baked yet are solved live, tracking
+  // restarts from wherever playback left the robot
+  if (model.trajectory &&
+      model.trajectory->sample(elapsed_seconds.count(), model)) {
+    model.right_puma_tracking.reset();
+    return;
+  }
+  solve_motion(model, progress);
+}
+
+void solve_motion(internal::motion_state &model, float progress) {
+  const auto &settings = model.current_settings.value();
+
+  // left puma - linear interpolation of start and end config
+  model.left_puma =
+      internal::lerp(settings.start_state, settings.end_state, progress);
+
+  // right puma - find inverse solution for each position
+  const auto curr_pos =
+      glm::mix(settings.position_start, settings.position_end, progress);
+  const auto curr_rot = glm::slerp(settings.quat_rotation_start,
+                                   settings.quat_rotation_end, progress);
+
+  // stays on the branch of the current right puma state, the state is kept
+  // as is when the pose is unreachable
+  const puma_pos target{curr_pos, curr_rot};
+  solve_task_tracked(model.left_puma, target, model.right_puma_tracking,
+                     model.right_puma);
+
+  if (settings.refine_ik) {
+    model.right_puma_residual = refine_task(model.right_puma, target).position;
+  } else {
+    model.right_puma_residual =
+        glm::length(curr_pos - get_actuator_pos(model.right_puma));
+  }
+}
+
+std::uint64_t run_motion(internal::motion_state &motion, sim_clock &clock,
+                         std::uint64_t max_ticks) {
+  if (!motion.current_settings) {
+    return 0;
+  }
+  motion.current_settings->start_time = clock.now();
+  std::uint64_t ticks = 0;
+  while (motion.current_settings && ticks < max_ticks) {
+    animate(motion, clock.now());
+    clock.advance();
+    ++ticks;
+  }
+  return ticks;
+}
+
+simulation_thread::simulation_thread(sim_clock clock) : clock(clock) {}
+
+simulation_thread::~simulation_thread() { stop(); }
+
+void simulation_thread::start() {
+  if (worker.joinable()) {
+    return;
+  }
+  stop_requested.store(false, std::memory_order_relaxed);
+  worker = std::thread([this]() { run(); });
+}
+
+void simulation_thread::stop() {
+  {
+    std::lock_guard lock(wake_mutex);
+    stop_requested.store(true, std::memory_order_relaxed);
+    woken = true;
+  }
+  wake.notify_one();
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+std::uint64_t simulation_thread::submit(const internal::motion_state &motion) {
+  auto &cmd = commands.back();
+  cmd.id = next_command_id++;
+  cmd.settings = motion.current_settings;
+  cmd.trajectory = motion.trajectory;
+  cmd.program = motion.program;
+  cmd.left_puma = motion.left_puma;
+  cmd.right_puma = motion.right_puma;
+  commands.publish();
+  {
+    std::lock_guard lock(wake_mutex);
+    woken = true;
+  }
+  wake.notify_one();
+  return cmd.id;
+}
+
+void simulation_thread::run() {
+  using steady = std::chrono::steady_clock;
+  const auto wall_step = std::chrono::duration_cast<steady::duration>(
+      std::max(clock.step, sim_clock::duration{1}));
+
+  std::uint64_t tick = 0;
+  std::uint64_t applied = 0;
+  auto next_tick = steady::now();
+
+  while (!stop_requested.load(std::memory_order_relaxed)) {
+    if (commands.update() && commands.front().id != applied) {
+      const auto &cmd = commands.front();
+      applied = cmd.id;
+      motion.current_settings = cmd.settings;
+      motion.trajectory = cmd.trajectory;
+      motion.program = cmd.program;
+      if (motion.current_settings) {
+        motion.current_settings->start_time = clock.now();
+      }
+      motion.left_puma = cmd.left_puma;
+      motion.right_puma = cmd.right_puma;
+      motion.right_puma_tracking.reset();
+    }
+
+    animate(motion, clock.now());
+
+    auto &out = snapshots.back();
+    out.tick = tick;
+    out.command_id = applied;
+    out.running = motion.current_settings.has_value();
+    out.left_puma = motion.left_puma;
+    out.right_puma = motion.right_puma;
+    out.right_puma_residual = motion.right_puma_residual;
+    snapshots.publish();
+
+    ++tick;
+    clock.advance();
+    if (!clock.paced()) {
+      // nothing to play, the idle state is published once and the thread
+      // sleeps until the render thread submits or stops it
+      if (!motion.current_settings) {
+        std::unique_lock lock(wake_mutex);
+        wake.wait(lock, [this]() { return woken; });
+        woken = false;
+      }
+      continue;
+    }
+
+    // after a long stall (debugger, suspended process) the missed ticks are
+    // not replayed in a burst, simulated time just resumes
+    next_tick += wall_step;
+    const auto now = steady::now();
+    if (now - next_tick > 100 * wall_step) {
+      next_tick = now;
+    }
+    std::this_thread::sleep_until(next_tick);
+  }
+}
+
+} // namespace pusn
@@ -0,0 +1,198 @@
+#include <toolpath.hpp>
+
+#include <bit>
+#include <cstring>
+#include <fstream>
+
+#include <motion_program.hpp>
+
+namespace pusn {
+
+static_assert(std::endian::native == std::endian::little,
+              "toolpath files are little endian and used as mapped");
+static_assert(sizeof(toolpath_header) == 40);
+
+compiled_toolpath::~compiled_toolpath() { release(); }
+
+compiled_toolpath::compiled_toolpath(compiled_toolpath &&other) noexcept
+    : storage(std::move(other.storage)), file(std::move(other.file)),
+      bytes(other.bytes) {
+  other.bytes = nullptr;
+}
+
+compiled_toolpath &
+compiled_toolpath::operator=(compiled_toolpath &&other) noexcept {
+  if (this != &other) {
+    release();
+    storage = std::move(other.storage);
+    file = std::move(other.file);
+    bytes = other.bytes;
+    other.bytes = nullptr;
+  }
+  return *this;
+}
+
+void compiled_toolpath::release() {
+  storage.clear();
+  file = {};
+  bytes = nullptr;
+}
+
+std::size_t compiled_toolpath::image_size(std::size_t waypoint_count) {
+  return sizeof(toolpath_header) +
+         waypoint_count * (toolpath_columns * sizeof(float) + 1);
+}
+
+std::uint64_t
+compiled_toolpath::checksum(std::span<const std::uint8_t> payload) {
+  std::uint64_t hash = 0xcbf29ce484222325ull;
+  for (const auto b : payload) {
+    hash = (hash ^ b) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+compiled_toolpath
+compiled_toolpath::compile(const internal::puma_state &robot,
+                           std::span<const internal::waypoint> path) {
+  using enum toolpath_column;
+  const auto n = path.size();
+  toolpath_header h{};
+  std::memcpy(h.magic, magic, sizeof(magic));
+  h.version = version;
+  h.waypoint_count = static_cast<std::uint32_t>(n);
+  h.links[0] = robot.l1;
+  h.links[1] = robot.l3;
+  h.links[2] = robot.l4;
+
+  compiled_toolpath ret;
+  ret.storage.resize(image_size(n));
+  auto *columns = reinterpret_cast<float *>(ret.storage.data() + sizeof(h));
+  auto *branches = ret.storage.data() + sizeof(h) +
+                   toolpath_columns * n * sizeof(float);
+  const auto at = [&](toolpath_column c, std::size_t i) -> float & {
+    return columns[static_cast<std::size_t>(c) * n + i];
+  };
+
+  ik_cache cache;
+  auto previous = robot;
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto &w = path[i];
+    internal::puma_state joints;
+    branches[i] = solve_waypoint(cache, robot, w, previous, joints);
+    previous = joints;
+
+    at(position_x, i) = w.position.x;
+    at(position_y, i) = w.position.y;
+    at(position_z, i) = w.position.z;
+    at(rotation_x, i) = w.rotation.x;
+    at(rotation_y, i) = w.rotation.y;
+    at(rotation_z, i) = w.rotation.z;
+    at(rotation_w, i) = w.rotation.w;
+    at(duration, i) = w.duration;
+    at(q2, i) = joints.q2;
+    at(alpha_1, i) = joints.alpha_1;
+    at(alpha_2, i) = joints.alpha_2;
+    at(alpha_3, i) = joints.alpha_3;
+    at(alpha_4, i) = joints.alpha_4;
+    at(alpha_5, i) = joints.alpha_5;
+  }
+
+  h.checksum = checksum({ret.storage.data() + sizeof(h),
+                         ret.storage.size() - sizeof(h)});
+  std::memcpy(ret.storage.data(), &h, sizeof(h));
+  ret.bytes = ret.storage.data();
+  return ret;
+}
+
+bool compiled_toolpath::save(const std::filesystem::path &path) const {
+  if (empty()) {
+    return false;
+  }
+  std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+  ofs.write(reinterpret_cast<const char *>(bytes),
+            static_cast<std::streamsize>(image_size(size())));
+  return static_cast<bool>(ofs);
+}
+
+std::optional<compiled_toolpath>
+compiled_toolpath::load(const std::filesystem::path &path) {
+  compiled_toolpath ret;
+  std::size_t size = 0;
+
+  ret.file = utils::mapped_file(path);
+  if (!ret.file.is_open() || ret.file.size() == 0) {
+    return std::nullopt;
+  }
+  size = ret.file.size();
+  ret.bytes = ret.file.bytes().data();
+
+  if (size < sizeof(toolpath_header)) {
+    return std::nullopt;
+  }
+  const auto &h = ret.header();
+  if (std::memcmp(h.magic, magic, sizeof(magic)) != 0 ||
+      h.version != version || size != image_size(h.waypoint_count)) {
+    return std::nullopt;
+  }
+  if (checksum({ret.bytes + sizeof(h), size - sizeof(h)}) != h.checksum) {
+    return std::nullopt;
+  }
+  return ret;
+}
+
+bool compiled_toolpath::matches(const internal::puma_state &robot) const {
+  if (empty()) {
+    return false;
+  }
+  const auto &h = header();
+  return h.links[0] == robot.l1 && h.links[1] == robot.l3 &&
+         h.links[2] == robot.l4;
+}
+
+std::vector<internal::waypoint> compiled_toolpath::waypoints() const {
+  using enum toolpath_column;
+  const auto px = column(position_x), py = column(position_y),
+             pz = column(position_z);
+  const auto rx = column(rotation_x), ry = column(rotation_y),
+             rz = column(rotation_z), rw = column(rotation_w);
+  const auto d = column(duration);
+
+  std::vector<internal::waypoint> ret(size());
+  for (std::size_t i = 0; i < ret.size(); ++i) {
+    ret[i] = {{px[i], py[i], pz[i]}, glm::quat(rw[i], rx[i], ry[i], rz[i]),
+              d[i]};
+  }
+  return ret;
+}
+
+std::vector<internal::puma_state>
+compiled_toolpath::states(const internal::puma_state &robot) const {
+  using enum toolpath_column;
+  const auto c_q2 = column(q2);
+  const auto a1 = column(alpha_1), a2 = column(alpha_2),
+             a3 = column(alpha_3), a4 = column(alpha_4),
+             a5 = column(alpha_5);
+
+  std::vector<internal::puma_state> ret(size(), robot);
+  for (std::size_t i = 0; i < ret.size(); ++i) {
+    auto &s = ret[i];
+    s.q2 = c_q2[i];
+    s.alpha_1 = a1[i];
+    s.alpha_2 = a2[i];
+    s.alpha_3 = a3[i];
+    s.alpha_4 = a4[i];
+    s.alpha_5 = a5[i];
+  }
+  return ret;
+}
+
+std::size_t compiled_toolpath::unreachable() const {
+  std::size_t ret = 0;
+  for (const auto b : branches()) {
+    ret += b == internal::ik_tracking::no_branch;
+  }
+  return ret;
+}
+
+} // namespace pusn
@@ -0,0 +1,87 @@
+#include <trajectory.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#include <simulation.hpp>
+
+namespace pusn {
+
+baked_trajectory::baked_trajectory(float length, float step)
+    : length(length), step(step),
+      samples(static_cast<std::size_t>(std::ceil(length / step)) + 1) {}
+
+bool baked_trajectory::sample(float t, internal::motion_state &out) const {
+  const auto last = size() - 1;
+  const float x = std::max(t, 0.f) / step;
+  const auto i = std::min(static_cast<std::size_t>(x), last);
+  const auto next = std::min(i + 1, last);
+  if (next >= ready()) {
+    return false;
+  }
+
+  const auto &a = samples[i];
+  const auto &b = samples[next];
+  const float s = i == last ? 0.f : x - static_cast<float>(i);
+  out.left_puma = internal::lerp(a.left_puma, b.left_puma, s);
+  out.right_puma = internal::lerp(a.right_puma, b.right_puma, s);
+  out.right_puma_residual =
+      glm::mix(a.right_puma_residual, b.right_puma_residual, s);
+  return true;
+}
+
+void bake_trajectory(baked_trajectory &trajectory,
+                     const internal::simulation_settings &settings,
+                     const internal::puma_state &left_puma,
+                     const internal::puma_state &right_puma,
+                     const std::atomic<bool> *stop) {
+  // the same solve animate runs live, at fixed progress values
+  internal::motion_state motion;
+  motion.current_settings = settings;
+  motion.left_puma = left_puma;
+  motion.right_puma = right_puma;
+
+  const auto count = trajectory.size();
+  for (std::size_t i = 0; i < count; ++i) {
+    const float t = static_cast<float>(i) * trajectory.step;
+    solve_motion(motion, std::min(t / trajectory.length, 1.f));
+    trajectory.samples[i] = {motion.left_puma, motion.right_puma,
+                             motion.right_puma_residual};
+
+    if ((i + 1) % baked_trajectory::chunk == 0 || i + 1 == count) {
+      trajectory.baked.store(i + 1, std::memory_order_release);
+      if (trajectory.cancelled.load(std::memory_order_relaxed) ||
+          (stop && stop->load(std::memory_order_relaxed))) {
+        return;
+      }
+    }
+  }
+}
+
+trajectory_baker::~trajectory_baker() { cancel(); }
+
+void trajectory_baker::cancel() {
+  if (current) {
+    current->cancelled.store(true, std::memory_order_relaxed);
+  }
+  if (worker.joinable()) {
+    worker.join();
+  }
+  current.reset();
+}
+
+std::shared_ptr<const baked_trajectory>
+trajectory_baker::bake(const internal::simulation_settings &settings,
+                       const internal::puma_state &left_puma,
+                       const internal::puma_state &right_puma, float step) {
+  cancel();
+  current = std::make_shared<baked_trajectory>(settings.length, step);
+
+  worker = std::thread(
+      [trajectory = current, settings, left_puma, right_puma]() {
+        bake_trajectory(*trajectory, settings, left_puma, right_puma);
+      });
+  return current;
+}
+
+} // namespace pusn
@@ -1,48 +1,140 @@
 #include <utils.hpp>
 
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace pusn {
 namespace utils {
-std::string read_text_file(std::filesystem::path shader_file) {
-  std::ifstream ifs;
+void mapped_file::line_view::iterator::find_line() {
+  if (it == end) {
+    next = end;
+    line = {};
+    return;
+  }
+  const char *eol = static_cast<const char *>(std::memchr(it, '\n', end - it));
+  line = {it, static_cast<std::size_t>((eol ? eol : end) - it)};
+  next = eol ? eol + 1 : end;
+}
 
-  auto ex = ifs.exceptions();
-  ex |= std::ios_base::badbit | std::ios_base::failbit;
-  ifs.exceptions(ex);
+mapped_file::mapped_file(const std::filesystem::path &path) {
+#ifndef _WIN32
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return;
+  }
+  const auto size = static_cast<std::size_t>(st.st_size);
+  // mmap refuses empty ranges
+  if (size > 0) {
+    void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+      close(fd);
+      return;
+    }
+    mapping = mapped;
+    begin = static_cast<const char *>(mapped);
+    length = size;
+  }
+  close(fd);
+#else
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs) {
+    return;
+  }
+  storage.assign(std::istreambuf_iterator<char>{ifs}, {});
+  begin = storage.data();
+  length = storage.size();
+#endif
+  opened = true;
+}
 
-  ifs.open(shader_file);
-  ifs.ignore(std::numeric_limits<std::streamsize>::max());
-  auto size = ifs.gcount();
-  LOGGER_INFO("[FILE] Read {0} bytes from {1}", size, shader_file.string());
+mapped_file::~mapped_file() { release(); }
 
-  ifs.clear();
-  ifs.seekg(0, std::ios_base::beg);
+mapped_file::mapped_file(mapped_file &&other) noexcept
+    : storage(std::move(other.storage)),
+      mapping(std::exchange(other.mapping, nullptr)),
+      begin(std::exchange(other.begin, nullptr)),
+      length(std::exchange(other.length, 0)),
+      opened(std::exchange(other.opened, false)) {}
 
-  return std::string{std::istreambuf_iterator<char>{ifs}, {}};
+mapped_file &mapped_file::operator=(mapped_file &&other) noexcept {
+  if (this != &other) {
+    release();
+    storage = std::move(other.storage);
+    mapping = std::exchange(other.mapping, nullptr);
+    begin = std::exchange(other.begin, nullptr);
+    length = std::exchange(other.length, 0);
+    opened = std::exchange(other.opened, false);
+  }
+  return *this;
 }
 
-std::vector<std::string>
-read_text_lines_file(const std::filesystem::path input_file) {
-  std::vector<std::string> ret;
-  std::ifstream ifs;
-
-  auto ex = ifs.exceptions();
-  ex |= std::ios_base::badbit | std::ios_base::failbit;
-  ifs.exceptions(ex);
+void mapped_file::release() {
+#ifndef _WIN32
+  if (mapping) {
+    munmap(mapping, length);
+  }
+#endif
+  storage.clear();
+  mapping = nullptr;
+  begin = nullptr;
+  length = 0;
+  opened = false;
+}
 
-  ifs.open(input_file);
-  ifs.ignore(std::numeric_limits<std::streamsize>::max());
-  auto size = ifs.gcount();
-  LOGGER_INFO("[FILE] Read {0} bytes from {1}", size, input_file.string());
+void mapped_file::advise_sequential() const {
+#ifndef _WIN32
+  if (mapping) {
+    madvise(mapping, length, MADV_SEQUENTIAL);
+  }
+#endif
+}
 
-  ifs.clear();
-  ifs.seekg(0, std::ios_base::beg);
+void mapped_file::discard(std::size_t offset) const {
+#ifndef _WIN32
+  static const auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  const auto upto = std::min(offset, length) / page * page;
+  if (mapping && upto > 0) {
+    madvise(mapping, upto, MADV_DONTNEED);
+  }
+#endif
+}
 
-  auto full_program = std::string{std::istreambuf_iterator<char>{ifs}, {}};
-  std::stringstream ss(full_program);
+std::string read_text_file(std::filesystem::path shader_file) {
+  const mapped_file file(shader_file);
+  if (!file.is_open()) {
+    LOGGER_ERROR("[FILE] Cannot read {0}", shader_file.string());
+    return {};
+  }
+  LOGGER_INFO("[FILE] Read {0} bytes from {1}", file.size(),
+              shader_file.string());
+  return std::string{file.text()};
+}
 
-  std::string current;
-  while (getline(ss, current)) {
-    ret.push_back(current);
+std::vector<std::string>
+read_text_lines_file(const std::filesystem::path input_file) {
+  std::vector<std::string> ret;
+  const mapped_file file(input_file);
+  if (!file.is_open()) {
+    LOGGER_ERROR("[FILE] Cannot read {0}", input_file.string());
+    return ret;
+  }
+  LOGGER_INFO("[FILE] Read {0} bytes from {1}", file.size(),
+              input_file.string());
+  for (const auto line : file.lines()) {
+    ret.emplace_back(line);
   }
   return ret;
 }